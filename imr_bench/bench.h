@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace imr::bench
+{
+	// results added here can't be optimized away
+	inline volatile uint64_t sink = 0;
+	inline void keep(uint64_t value)
+	{
+		sink = sink + value;
+	}
+
+	struct options
+	{
+		int samples = 15;
+		// batches are repeated until one sample takes at least this long
+		double min_sample_ms = 20.0;
+		// runs only the benchmarks whose name contains it
+		std::string filter = {};
+	};
+
+	// nanoseconds per operation over the samples, the median is the number to compare between runs
+	struct measurement
+	{
+		std::string name = {};
+		size_t ops_per_sample = 0;
+		int samples = 0;
+		double median_ns = 0;
+		double min_ns = 0;
+		double max_ns = 0;
+	};
+
+	class runner
+	{
+	public:
+		explicit runner(const options& opt)
+			: _options(opt)
+		{
+		}
+
+		bool enabled(const std::string& name) const
+		{
+			return _options.filter.empty() || name.find(_options.filter) != std::string::npos;
+		}
+
+		// batch does ops_per_batch operations. it runs once to warm up, then the batch count per sample is doubled until
+		// a sample is long enough for the clock
+		void run(const std::string& name, size_t ops_per_batch, const std::function<void()>& batch)
+		{
+			if (enabled(name) == false)
+			{
+				return;
+			}
+			using clock = std::chrono::steady_clock;
+			auto time_batches = [&batch](size_t count)
+			{
+				auto start = clock::now();
+				for (size_t i = 0; i < count; ++i)
+				{
+					batch();
+				}
+				return std::chrono::duration<double, std::nano>(clock::now() - start).count();
+			};
+
+			batch();
+			size_t batches = 1;
+			while (time_batches(batches) < _options.min_sample_ms * 1e6 && batches < (size_t(1) << 30))
+			{
+				batches *= 2;
+			}
+
+			const double ops = static_cast<double>(batches * ops_per_batch);
+			std::vector<double> per_op(std::max(1, _options.samples));
+			for (auto& ns : per_op)
+			{
+				ns = time_batches(batches) / ops;
+			}
+			std::sort(per_op.begin(), per_op.end());
+			_results.push_back({
+				.name = name,
+				.ops_per_sample = batches * ops_per_batch,
+				.samples = static_cast<int>(per_op.size()),
+				.median_ns = per_op[per_op.size() / 2],
+				.min_ns = per_op.front(),
+				.max_ns = per_op.back(),
+				});
+		}
+
+		const std::vector<measurement>& results() const { return _results; }
+
+		void write_json(std::ostream& os) const
+		{
+			os << std::fixed << std::setprecision(3) << "{\n\t\"benchmarks\": [\n";
+			for (size_t i = 0; i < _results.size(); ++i)
+			{
+				auto& r = _results[i];
+				os << "\t\t{ \"name\": \"" << r.name << "\", \"ops_per_sample\": " << r.ops_per_sample << ", \"samples\": " << r.samples
+					<< ", \"median_ns\": " << r.median_ns << ", \"min_ns\": " << r.min_ns << ", \"max_ns\": " << r.max_ns << " }"
+					<< (i + 1 < _results.size() ? ",\n" : "\n");
+			}
+			os << "\t]\n}\n";
+		}
+
+		void write_csv(std::ostream& os) const
+		{
+			os << std::fixed << std::setprecision(3) << "name,ops_per_sample,samples,median_ns,min_ns,max_ns\n";
+			for (auto& r : _results)
+			{
+				os << r.name << "," << r.ops_per_sample << "," << r.samples << "," << r.median_ns << "," << r.min_ns << "," << r.max_ns << "\n";
+			}
+		}
+
+	private:
+		options _options = {};
+		std::vector<measurement> _results = {};
+	};
+}
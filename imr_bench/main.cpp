@@ -0,0 +1,569 @@
+#include "bench.h"
+#include "imr_opengl3.h"
+#include "imr_text.h"
+#include "animation.h"
+#include "tweeners.h"
+#include "gameworld.h"
+#include "MaxRectsBinPack.h"
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#include "egl_context.h"
+#endif
+#include <fstream>
+#include <iostream>
+
+// microbenchmarks for the cpu side hot paths. prints json (or csv with --csv) to stdout or --out, diagnostics go to stderr.
+// numbers are nanoseconds per operation, the median over --samples samples of at least --min-ms each
+// usage: imr_bench [--csv] [--filter name] [--samples 15] [--min-ms 20] [--font path.ttf] [--out results.json]
+// build (linux): cmake -S . -B build -DCMAKE_BUILD_TYPE=Release && cmake --build build --target imr_bench, the target needs box2d installed
+namespace
+{
+	struct options
+	{
+		imr::bench::options bench = {};
+		bool csv = false;
+		std::string font = "../imr_engine/resources/font/neodgm.ttf";
+		std::string out = {};
+	};
+
+	bool parse(int argc, char** argv, options& opt)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (arg == "--csv")
+			{
+				opt.csv = true;
+				continue;
+			}
+			if (i + 1 >= argc)
+			{
+				return false;
+			}
+			const char* value = argv[++i];
+			if (arg == "--filter") opt.bench.filter = value;
+			else if (arg == "--samples") opt.bench.samples = std::atoi(value);
+			else if (arg == "--min-ms") opt.bench.min_sample_ms = std::atof(value);
+			else if (arg == "--font") opt.font = value;
+			else if (arg == "--out") opt.out = value;
+			else return false;
+		}
+		return opt.bench.samples > 0 && opt.bench.min_sample_ms > 0;
+	}
+
+	// a context nobody sees, the gl benchmarks draw into an offscreen target
+	class gl_context
+	{
+	public:
+		~gl_context()
+		{
+			destroy();
+		}
+
+		imr::result create()
+		{
+#ifdef _WIN32
+			if (!glfwInit())
+			{
+				return { .type = imr::result_type::fail, .error_code = 1, .msg = "fail to init glfw" };
+			}
+			glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+			glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+			glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+			glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+			_window = glfwCreateWindow(64, 64, "imr_bench", NULL, NULL);
+			if (_window == nullptr)
+			{
+				glfwTerminate();
+				return { .type = imr::result_type::fail, .error_code = 2, .msg = "fail to create the window" };
+			}
+			glfwMakeContextCurrent(_window);
+			gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+			imr::gl_proc_loader = (GLADloadproc)glfwGetProcAddress;
+			// vsync would make the gl benchmarks measure the display
+			glfwSwapInterval(0);
+			return {};
+#else
+			IMRRESULT(_egl.create());
+			imr::gl_proc_loader = &imr::headless::egl_context::proc_address;
+			return {};
+#endif
+		}
+
+		void destroy()
+		{
+#ifdef _WIN32
+			if (_window)
+			{
+				glfwDestroyWindow(_window);
+				glfwTerminate();
+				_window = nullptr;
+			}
+#else
+			_egl.destroy();
+#endif
+		}
+
+	private:
+#ifdef _WIN32
+		GLFWwindow* _window = {};
+#else
+		imr::headless::egl_context _egl = {};
+#endif
+	};
+
+	// fixed seed, the inputs are the same on every run
+	struct lcg
+	{
+		uint32_t state = 12345;
+		uint32_t next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return state >> 8;
+		}
+		int range(int from, int to)
+		{
+			return from + static_cast<int>(next() % static_cast<uint32_t>(to - from + 1));
+		}
+	};
+
+	void append_utf8(std::string& out, uint32_t c)
+	{
+		if (c < 0x80)
+		{
+			out += static_cast<char>(c);
+		}
+		else if (c < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (c >> 6));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xE0 | (c >> 12));
+			out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (c & 0x3F));
+		}
+	}
+
+	constexpr size_t INSTANCES_PER_BATCH = 4096;
+
+	void stage_instances(float offset)
+	{
+		for (size_t i = 0; i < INSTANCES_PER_BATCH; ++i)
+		{
+			imr::instancing::instance({
+				.position = { static_cast<float>(i % 64) * 4.0f - 128.0f + offset, static_cast<float>(i / 64) * 4.0f - 128.0f },
+				.scale = { 3.0f, 3.0f },
+				.rotation = static_cast<float>(i),
+				.color = { 1, 1, 1, 0.5f },
+				});
+		}
+	}
+
+	// each variant is reported twice: staging alone, and the whole frame with camera begin/end, upload and draw.
+	// the empty frame is the fixed cost of a frame without instances
+	void bench_instancing(imr::bench::runner& runner, imr::Iframe_buffer* target)
+	{
+		struct variant
+		{
+			const char* name = {};
+			bool compact = false;
+			bool culling = false;
+		};
+		const variant variants[] = {
+			{ "instancing::instance" },
+			{ "instancing::instance compact", true },
+			// everything lands outside the camera, only the packing up to the cull test is left
+			{ "instancing::instance culled", false, true },
+		};
+		for (auto& v : variants)
+		{
+			const float offset = v.culling ? 100000.0f : 0.0f;
+			if (imr::succeed(imr::camera::begin({ .frame_buffer = target, .culling = v.culling })))
+			{
+				if (imr::succeed(imr::instancing::begin({ .texture_info = imr::get_white_texture_info(), .compact = v.compact })))
+				{
+					runner.run(std::string(v.name) + " staging", INSTANCES_PER_BATCH, [&]()
+						{
+							stage_instances(offset);
+							// dropped unseen, end draws nothing
+							CTX->instancing_stack.top().instance_count = 0;
+						});
+					imr::instancing::end();
+				}
+				imr::camera::end();
+			}
+
+			runner.run(std::string(v.name) + " frame", INSTANCES_PER_BATCH, [&]()
+				{
+					if (imr::failed(imr::camera::begin({ .frame_buffer = target, .culling = v.culling })))
+					{
+						return;
+					}
+					if (imr::succeed(imr::instancing::begin({ .texture_info = imr::get_white_texture_info(), .compact = v.compact })))
+					{
+						stage_instances(offset);
+						imr::instancing::end();
+					}
+					imr::camera::end();
+				});
+		}
+
+		runner.run("instancing::empty frame", 1, [&]()
+			{
+				if (imr::failed(imr::camera::begin({ .frame_buffer = target })))
+				{
+					return;
+				}
+				if (imr::succeed(imr::instancing::begin({ .texture_info = imr::get_white_texture_info() })))
+				{
+					imr::instancing::end();
+				}
+				imr::camera::end();
+			});
+	}
+
+	void bench_camera(imr::bench::runner& runner, imr::Iframe_buffer* target)
+	{
+		constexpr size_t COUNT = 1024;
+		std::vector<imr::float2> points(COUNT);
+		std::vector<imr::float2> out(COUNT);
+		lcg random = {};
+		for (auto& p : points)
+		{
+			p = imr::float2(static_cast<float>(random.range(0, 255)), static_cast<float>(random.range(0, 255)));
+		}
+		if (imr::failed(imr::camera::begin({ .frame_buffer = target })))
+		{
+			return;
+		}
+		imr::camera::camera({ .position = { 30, -20 }, .scale = { 1.5f, 1.5f }, .rotation = 0.3f });
+		runner.run("camera::screen_to_world", COUNT, [&]()
+			{
+				for (size_t i = 0; i < COUNT; ++i)
+				{
+					out[i] = std::get<1>(imr::camera::screen_to_world(points[i]));
+				}
+				imr::bench::keep(static_cast<uint64_t>(out.back().x));
+			});
+		runner.run("camera::screen_to_world span", COUNT, [&]()
+			{
+				imr::camera::screen_to_world(points, out);
+				imr::bench::keep(static_cast<uint64_t>(out.back().x));
+			});
+		imr::camera::end();
+	}
+
+	void bench_text(imr::bench::runner& runner, imr::Iframe_buffer* target, const std::string& font_path)
+	{
+		if (runner.enabled("text::") == false && runner.enabled("font_info::") == false)
+		{
+			return;
+		}
+		imr::text::font_info font = {};
+		auto ret = font.create(font_path.c_str(), 0, 16);
+		if (imr::failed(ret))
+		{
+			std::cerr << "skip text benchmarks, " << font_path << ": " << ret.msg << std::endl;
+			return;
+		}
+
+		std::string ascii = {};
+		std::string hangul = {};
+		std::vector<unsigned long> code_points = {};
+		for (uint32_t i = 0; i < 512; ++i)
+		{
+			append_utf8(ascii, 0x20 + i % 95);
+			// 64 distinct syllables so every glyph is in the atlas after the warm up
+			const uint32_t syllable = 0xAC00 + (i % 64) * 37;
+			append_utf8(hangul, syllable);
+			code_points.push_back(i % 2 ? syllable : 0x20 + i % 95);
+		}
+
+		auto layout = [&](const std::string& txt)
+			{
+				if (imr::failed(imr::camera::begin({ .frame_buffer = target, .origin = imr::camera::left_top })))
+				{
+					return;
+				}
+				imr::text::begin(&font);
+				imr::text::text(txt, { 0, 0 });
+				imr::text::end();
+				imr::camera::end();
+			};
+		runner.run("text::text ascii", 512, [&]() { layout(ascii); });
+		runner.run("text::text hangul", 512, [&]() { layout(hangul); });
+		runner.run("font_info::get_char_rect hit", code_points.size(), [&]()
+			{
+				uint64_t sum = 0;
+				for (auto c : code_points)
+				{
+					sum += font.get_char_rect(c).tex_coords.x;
+				}
+				imr::bench::keep(sum);
+			});
+	}
+
+	struct pooled
+	{
+		float value[16] = {};
+		void on_reused() { value[0] = 1.0f; }
+		void on_free() { value[0] = 0.0f; }
+	};
+
+	void bench_memory_pool(imr::bench::runner& runner)
+	{
+		constexpr size_t COUNT = 1024;
+		memory_pool<pooled> pool = {};
+		pool.reserve(COUNT);
+		std::vector<pooled*> items(COUNT);
+		runner.run("memory_pool create+destroy", COUNT, [&]()
+			{
+				for (auto& p : items)
+				{
+					p = pool.create();
+				}
+				for (auto& p : items)
+				{
+					pool.destroy(&p);
+				}
+			});
+	}
+
+	void bench_tweener(imr::bench::runner& runner)
+	{
+		constexpr size_t STEPS = 1024;
+		float value = 0;
+		auto progress = [&value](float t, const float& v) { value = v; return true; };
+		const std::pair<const char*, tweeners::PLAY_MODE> modes[] = {
+			{ "tweener::update pingpong", tweeners::PINGPONG },
+			{ "tweener::update loop", tweeners::LOOP },
+		};
+		for (auto& [name, mode] : modes)
+		{
+			auto tweener = tweeners::builder<float>()
+				.from_to(0.0f, 1.0f, 0.5f, 0.0f, "easeInOutQuad")
+				.from_to(1.0f, 2.0f, 0.5f, 0.1f, "easeOutBounce")
+				.build(mode, 0, progress);
+			runner.run(name, STEPS, [&]()
+				{
+					for (size_t i = 0; i < STEPS; ++i)
+					{
+						tweener->update(1.0f / 60.0f);
+					}
+					imr::bench::keep(static_cast<uint64_t>(value * 1000.0f));
+				});
+		}
+	}
+
+	void bench_animation(imr::bench::runner& runner)
+	{
+		constexpr size_t STEPS = 1024;
+		// update only looks at the frame count, the sprites don't have to exist
+		auto data = std::make_shared<imr::sprite::animation::animation_state_data>();
+		auto& walk = data->animations["walk"];
+		walk.animation_name = "walk";
+		walk.duration = 0.8f;
+		for (int i = 0; i < 8; ++i)
+		{
+			walk.sprite_names.push_back("walk_" + std::to_string(i));
+			walk.sprite_infoes.push_back(nullptr);
+		}
+		imr::sprite::animation::animation_state state = {};
+		state.set_animation_state_data(data);
+		state.set_animation("walk", true);
+		runner.run("animation_state::update", STEPS, [&]()
+			{
+				for (size_t i = 0; i < STEPS; ++i)
+				{
+					state.update(1.0f / 60.0f);
+				}
+				imr::bench::keep(reinterpret_cast<uintptr_t>(state.current_sprite_info()));
+			});
+	}
+
+	void bench_rect_pack(imr::bench::runner& runner)
+	{
+		constexpr int COUNT = 256;
+		lcg random = {};
+		std::vector<std::pair<int, int>> sizes(COUNT);
+		for (auto& s : sizes)
+		{
+			s = { random.range(8, 40), random.range(8, 40) };
+		}
+		const std::pair<const char*, rbp::MaxRectsBinPack::FreeRectChoiceHeuristic> heuristics[] = {
+			{ "MaxRectsBinPack::Insert best_short_side_fit", rbp::MaxRectsBinPack::RectBestShortSideFit },
+			{ "MaxRectsBinPack::Insert best_long_side_fit", rbp::MaxRectsBinPack::RectBestLongSideFit },
+			{ "MaxRectsBinPack::Insert best_area_fit", rbp::MaxRectsBinPack::RectBestAreaFit },
+			{ "MaxRectsBinPack::Insert bottom_left", rbp::MaxRectsBinPack::RectBottomLeftRule },
+			{ "MaxRectsBinPack::Insert contact_point", rbp::MaxRectsBinPack::RectContactPointRule },
+		};
+		rbp::MaxRectsBinPack packer = {};
+		for (auto& [name, heuristic] : heuristics)
+		{
+			runner.run(name, COUNT, [&]()
+				{
+					packer.Init(1024, 1024, true);
+					uint64_t sum = 0;
+					for (auto& [w, h] : sizes)
+					{
+						sum += packer.Insert(w, h, heuristic).height;
+					}
+					imr::bench::keep(sum);
+				});
+		}
+	}
+
+	struct position_component : public imr::game::Icomponent
+	{
+		imr::float2 position = {};
+		void on_reused() { position = imr::float2(0, 0); }
+		void on_free() {}
+		void enable(bool flag) override {}
+		void added(imr::game::gameobject* go, imr::game::gameworld* world) override {}
+		void removed(imr::game::gameobject* go, imr::game::gameworld* world) override {}
+	};
+
+	struct velocity_component : public position_component {};
+	struct sprite_component : public position_component {};
+	struct health_component : public position_component {};
+
+	class bench_game_context : public imr::game::Igame_context {};
+
+	void bench_gameobject(imr::bench::runner& runner)
+	{
+		if (runner.enabled("gameobject::") == false)
+		{
+			return;
+		}
+		constexpr size_t COUNT = 1024;
+		bench_game_context context = {};
+		// memory_pool never grows past the reserved capacity
+		context.pool<imr::game::gameobject>()->reserve(COUNT + 1);
+		context.pool<position_component>()->reserve(COUNT + 1);
+		context.pool<velocity_component>()->reserve(COUNT + 1);
+		context.pool<sprite_component>()->reserve(COUNT + 1);
+		context.pool<health_component>()->reserve(COUNT + 1);
+
+		imr::game::universe universe = {};
+		universe.set_game_context(&context);
+		auto* world = universe.create_world(0);
+
+		std::vector<imr::game::gameobject*> objects(COUNT);
+		runner.run("gameobject::create_gameobject+destroy_gameobject", COUNT, [&]()
+			{
+				for (auto& go : objects)
+				{
+					go = world->create_gameobject();
+					go->add_component<position_component>();
+				}
+				// destroying the object removes its components
+				for (auto& go : objects)
+				{
+					world->destroy_gameobject(&go);
+				}
+			});
+
+		for (auto& go : objects)
+		{
+			go = world->create_gameobject();
+		}
+		runner.run("gameobject::add_component+remove_component", COUNT, [&]()
+			{
+				for (auto* go : objects)
+				{
+					go->add_component<position_component>();
+				}
+				for (auto* go : objects)
+				{
+					go->remove_component<position_component>();
+				}
+			});
+		for (auto& go : objects)
+		{
+			world->destroy_gameobject(&go);
+		}
+
+		auto* go = world->create_gameobject();
+		go->add_component<position_component>();
+		go->add_component<velocity_component>();
+		go->add_component<sprite_component>();
+		go->add_component<health_component>();
+		runner.run("gameobject::get_component", COUNT, [&]()
+			{
+				uint64_t found = 0;
+				for (size_t i = 0; i < COUNT; i += 4)
+				{
+					found += go->get_component<position_component>() != nullptr;
+					found += go->get_component<velocity_component>() != nullptr;
+					found += go->get_component<sprite_component>() != nullptr;
+					found += go->get_component<health_component>() != nullptr;
+				}
+				imr::bench::keep(found);
+			});
+		world->destroy_gameobject(&go);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	options opt = {};
+	if (parse(argc, argv, opt) == false)
+	{
+		std::cerr << "usage: imr_bench [--csv] [--filter name] [--samples 15] [--min-ms 20] [--font path.ttf] [--out results.json]" << std::endl;
+		return 1;
+	}
+	imr::bench::runner runner(opt.bench);
+
+	bench_memory_pool(runner);
+	bench_tweener(runner);
+	bench_animation(runner);
+	bench_rect_pack(runner);
+	bench_gameobject(runner);
+
+	gl_context gl = {};
+	auto ret = gl.create();
+	if (imr::succeed(ret))
+	{
+		ret = imr::initialize();
+	}
+	if (imr::succeed(ret))
+	{
+		std::cerr << glGetString(GL_RENDERER) << std::endl;
+		{
+			auto target = imr::acquire_render_target({ .width = 256, .height = 256 });
+			bench_instancing(runner, target.get());
+			bench_camera(runner, target.get());
+			bench_text(runner, target.get(), opt.font);
+		}
+		imr::deinitialize();
+	}
+	else
+	{
+		std::cerr << "skip gl benchmarks: " << ret.msg << std::endl;
+	}
+	gl.destroy();
+
+	std::ofstream file = {};
+	if (opt.out.empty() == false)
+	{
+		file.open(opt.out);
+		if (file.is_open() == false)
+		{
+			std::cerr << "fail to write " << opt.out << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& os = opt.out.empty() ? std::cout : file;
+	if (opt.csv)
+	{
+		runner.write_csv(os);
+	}
+	else
+	{
+		runner.write_json(os);
+	}
+	return 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <string>
 #include <memory>
 #include <unordered_map>
@@ -8,6 +9,7 @@
 #include <typeindex>
 #include <functional>
 #include <vector>
+#include <span>
 
 #define IMRRESULT(R) \
 {\
@@ -34,6 +36,15 @@ namespace imr
 		int2& operator-=(const int2& rh) { this->x -= rh.x; this->y -= rh.y; return *this; }
 	};
 
+	// int2 inside int4, gcc and clang don't allow a type with constructors in an anonymous struct
+	struct int2_field
+	{
+		int x;
+		int y;
+		operator int2() const { return { x, y }; }
+		int2_field& operator=(const int2& rh) { x = rh.x; y = rh.y; return *this; }
+	};
+
 	union int4
 	{
 		int value[4];
@@ -44,16 +55,16 @@ namespace imr
 			int w;
 		};
 		struct {
-			int2 xy;
-			int2 zw;
+			int2_field xy;
+			int2_field zw;
 		};
 		struct {
-			int2 lt;
-			int2 rb;
+			int2_field lt;
+			int2_field rb;
 		};
 		int operator[](size_t index) const { return value[index]; }
 		int4(int _x, int _y, int _z, int _w) : x(_x), y(_y), z(_z), w(_w) {};
-		int4(int2 _xy, int2 _zw) : xy(_xy), zw(_zw) {};
+		int4(int2 _xy, int2 _zw) : x(_xy.x), y(_xy.y), z(_zw.x), w(_zw.y) {};
 		int4() : x(), y(), z(), w() {};
 		int2 rt() const { return { z, y }; }
 		int2 lb() const { return { x, w }; }
@@ -81,7 +92,7 @@ namespace imr
 		}
 		float length() const
 		{
-			return std::sqrtf(x * x + y * y);
+			return std::sqrt(x * x + y * y);
 		}
 		float2 normalize() const
 		{
@@ -99,6 +110,15 @@ namespace imr
 		float2& operator/=(const float rh) { this->x /= rh; this->y /= rh; return *this; }
 	};
 
+	// float2 inside float4, see int2_field
+	struct float2_field
+	{
+		float x;
+		float y;
+		operator float2() const { return { x, y }; }
+		float2_field& operator=(const float2& rh) { x = rh.x; y = rh.y; return *this; }
+	};
+
 	union float4
 	{
 		float value[4];
@@ -109,8 +129,8 @@ namespace imr
 			float w;
 		};
 		struct {
-			float2 xy;
-			float2 zw;
+			float2_field xy;
+			float2_field zw;
 		};
 		float4& operator+=(const float4& rh) {
 			for (auto i = 0; i < 4; ++i)
@@ -121,7 +141,7 @@ namespace imr
 		}
 		float operator[](size_t index) const { return value[index]; }
 		float4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {};
-		float4(float2 _xy, float2 _zw) : xy(_xy), zw(_zw) {};
+		float4(float2 _xy, float2 _zw) : x(_xy.x), y(_xy.y), z(_zw.x), w(_zw.y) {};
 		float4() : x(), y(), z(), w() {};
 	};
 
@@ -147,7 +167,7 @@ namespace imr
 	inline float2 operator/(const int2& lh, const int2& rh) { return { lh.x / static_cast<float>(rh.x), lh.y / static_cast<float>(rh.y) }; }
 	inline float2 operator/(const float2& lh, float rh) { return { lh.x / rh, lh.y / rh }; }
 	inline float2 operator/(const int2& lh, float rh) { return { lh.x / rh, lh.y / rh }; }
-	inline float length(const float2& v) { return std::sqrtf(v.x * v.x + v.y * v.y); }
+	inline float length(const float2& v) { return std::sqrt(v.x * v.x + v.y * v.y); }
 	inline float4 operator*(const float4& lh, float rh) { return { lh.x * rh, lh.y * rh, lh.z * rh, lh.w * rh }; }
 
 	inline static float4 invalid = { 12452134234.0f, 0, 0, 0 };
@@ -198,13 +218,51 @@ namespace imr
 		virtual void bind() const = 0;
 		virtual void unbind() const = 0;
 		virtual void destroy() = 0;
+		// layer views of a texture array batch by their array
+		virtual const Itexture_info* batch_key() const { return this; }
+		virtual int layer() const { return 0; }
+		virtual bool is_array() const { return false; }
+		// texture coordinates of the whole image, a page smaller than its texture array covers part of the layer
+		virtual float4 uv_rect() const { return { 0, 1, 1, 0 }; }
+		// false while an async load is decoding or waiting for its upload
+		virtual bool ready() const { return true; }
+	};
+
+	enum class render_target_format
+	{
+		rgba8,
+		r8,
+		// needs EXT_color_buffer_float to be renderable on gles3
+		rgba16f,
+	};
+
+	enum class render_target_filter
+	{
+		nearest,
+		linear,
+	};
+
+	// everything a frame buffer is created from, the pool recycles targets with an equal descriptor
+	struct render_target_desc
+	{
+		int width = 0;
+		int height = 0;
+		int color_count = 1;
+		render_target_format color_formats[4] = {};
+		bool depth = false;
+		render_target_filter filter = render_target_filter::nearest;
+
+		bool operator==(const render_target_desc&) const = default;
+		size_t bytes() const;
 	};
 
 	struct Iframe_buffer
 	{
 		virtual ~Iframe_buffer() = default;
 		virtual uintptr_t get_color_texture(int idx = 0) = 0;
+		// rgba8 colors with a depth attachment
 		virtual imr::result create(int w, int h, int attachment_count = 1) = 0;
+		virtual imr::result create(const render_target_desc& desc) = 0;
 		virtual void destory() = 0;
 		virtual void bind() = 0;
 		virtual void unbind() = 0;
@@ -222,6 +280,7 @@ namespace imr
 			_h = h;
 			return {};
 		}
+		imr::result create(const render_target_desc& desc) override { return create(desc.width, desc.height); }
 		void destory() override {}
 		void bind() override;
 		void unbind() override {}
@@ -263,6 +322,10 @@ namespace imr
 			int2 size = {};
 			float2 offset = {};
 			float4 uv_rect = {};
+			// bounding radius around the pivot at scale 1, kept for culling
+			float radius = 0;
+			// page of the atlas texture, instances of the sprite sample it whichever page of the array was begun
+			float layer = 0;
 		};
 		atlas_info(std::shared_ptr<Itexture_info> tex)
 			: _texture_info(tex)
@@ -283,7 +346,11 @@ namespace imr
 	};
 
 	inline const char* INSTANCING_PROGRAM_NAME = "_IPN_";
+	inline const char* INSTANCING_COMPACT_PROGRAM_NAME = "_ICPN_";
+	inline const char* INSTANCING_ARRAY_PROGRAM_NAME = "_IAPN_";
+	inline const char* INSTANCING_COMPACT_ARRAY_PROGRAM_NAME = "_ICAPN_";
 	inline const char* TEXT_PROGRAM_NAME = "_TPN_";
+	inline const char* PRIMITIVE_PROGRAM_NAME = "_PPN_";
 	inline const char* LIGHT_PROGRAM_NAME = "_LPN_";
 	inline const char* SPRITE_PROGRAM_NAME = "_SPN_";
 	inline const char* MESH_PROGRAM_NAME = "_MPN_";
@@ -299,13 +366,69 @@ namespace imr
 	};
 
 	inline std::function<std::vector<char>(const std::string& path)> load_data = {};
+	// writes a file, returns false when it could not
+	inline std::function<bool(const std::string& path, const std::vector<char>& data)> save_data = {};
+	// directory for linked program binaries, read through load_data and written through save_data. empty disables the cache
+	inline std::string program_cache_dir = {};
 	std::tuple<result, std::shared_ptr<Itexture_info>> load_texture(const std::string& path);
 	std::tuple<result, std::shared_ptr<Itexture_info>> load_texture(const unsigned int* data, int w, int h);
+	// atlas pages as layers of one texture array, returns a layer view per path in order.
+	// smaller pages sit at the top left of their layer with their edges repeated into the padding. a view reports the
+	// page size and its part of the layer through uv_rect. normal maps of the pages load as another array in the same order
+	std::tuple<result, std::vector<std::shared_ptr<Itexture_info>>> load_texture_array(const std::vector<std::string>& paths);
+	// returns at once, the file is read and decoded on worker threads (load_data must be thread safe) and uploaded by
+	// update_texture_uploads. the handle draws as the white texture until then, and keeps doing so if the load failed
+	std::shared_ptr<Itexture_info> load_texture_async(const std::string& path);
+	// uploads decoded async textures, stops once byte_budget is spent but always uploads at least one. call once per frame
+	void update_texture_uploads(size_t byte_budget = 4 * 1024 * 1024);
+	// a pooled target, it goes back to the pool once the last handle is dropped
+	std::shared_ptr<Iframe_buffer> acquire_render_target(const render_target_desc& desc);
+	// a pooled target for this frame only, the pool takes it back at the next update_render_targets
+	Iframe_buffer* acquire_transient_render_target(const render_target_desc& desc);
+	// ends the frame for transient targets and frees pooled ones that stayed unused for max_idle_frames. call once per frame
+	void update_render_targets(int max_idle_frames = 120);
+	// forgets the gl bindings imr shadows. the outermost camera::begin does it, call it after gl code outside imr
+	// (e.g. imgui) ran inside a camera::begin/end
+	void invalidate_state_cache();
+	struct render_target_stats
+	{
+		// every frame buffer alive, pooled or not
+		size_t bytes = 0;
+		// pooled targets nobody holds, freed when they idle too long
+		size_t idle_bytes = 0;
+		int pooled_count = 0;
+		int idle_count = 0;
+	};
+	render_target_stats get_render_target_stats();
+	// rgba8 pixels of a color attachment, rows bottom first. call outside camera::begin/end
+	result read_pixels(Iframe_buffer* frame, std::vector<uint8_t>& out, int attachment_idx = 0);
+	// slot of a registered program, valid until it is unregistered. resolve once and use it instead of the name per draw.
+	// the generation tells a stale handle from the program that reused its slot
+	struct program_handle
+	{
+		int slot = -1;
+		uint32_t generation = 0;
+		bool operator==(const program_handle& rh) const = default;
+	};
+	inline const program_handle INVALID_PROGRAM_HANDLE = {};
 	result regist_program(const std::string& name, std::shared_ptr<Iprogram> program);
+	// regist_program returning the handle of the registered program
+	std::tuple<result, program_handle> regist_program_handle(const std::string& name, std::shared_ptr<Iprogram> program);
 	result unregist_program(const std::string& name);
+	program_handle get_program_handle(const std::string& name);
 	void push_program(const char* program_name);
+	void push_program(program_handle handle);
 	void pop_program();
 	const Itexture_info* get_white_texture_info();
+
+	// binding calls the backend issued and the ones it dropped because the state was already set
+	struct state_cache_stats
+	{
+		size_t issued = 0;
+		size_t skipped = 0;
+	};
+	const state_cache_stats& get_state_cache_stats();
+	void reset_state_cache_stats();
 }
 
 namespace imr::util
@@ -337,6 +460,19 @@ namespace imr::camera
 	{
 		Iframe_buffer* frame_buffer = {};
 		camera_origin origin = center;
+		// record draws and merge neighbouring ones with the same material at camera::end
+		bool deferred = false;
+		// skip sprites, instances, primitives and world space meshes outside the camera bounds
+		bool culling = false;
+	};
+
+	// items skipped by culling, see begin_args::culling
+	struct cull_stats
+	{
+		size_t sprites = 0;
+		size_t instances = 0;
+		size_t primitives = 0;
+		size_t meshes = 0;
 	};
 
 	struct camera_args
@@ -353,9 +489,67 @@ namespace imr::camera
 	void clear(const float4& color = {});
 	result camera(const camera_args& args);
 	std::tuple<result, float2> screen_to_world(const float2& scr_pos);
+	std::tuple<result, float2> world_to_screen(const float2& world_pos);
+	// converts every point with the current camera, out must hold as many points as in and may be the same memory
+	result screen_to_world(std::span<const float2> scr_pos, std::span<float2> out);
+	result world_to_screen(std::span<const float2> world_pos, std::span<float2> out);
+	const cull_stats& get_cull_stats();
+	void reset_cull_stats();
 	result end();
 }
 
+namespace imr::stats
+{
+	// work the renderer sent to gl
+	struct counters
+	{
+		size_t draw_calls = 0;
+		// instances of instanced draws
+		size_t instances = 0;
+		size_t vertices = 0;
+		// buffer and texture uploads
+		size_t upload_bytes = 0;
+		size_t program_switches = 0;
+		size_t texture_binds = 0;
+		size_t framebuffer_switches = 0;
+		// streaming ring reallocations, a steady number means an upload outgrows the rings every frame
+		size_t stream_grows = 0;
+	};
+
+	// one camera::begin/end, a nested pass is counted in its parent as well
+	struct camera_pass
+	{
+		int depth = 0;
+		int2 size = {};
+		counters work = {};
+		// gpu time when timer queries are available (only outermost passes can be timed), otherwise cpu time between begin and end
+		double ms = 0;
+		bool gpu_timed = false;
+	};
+
+	struct frame
+	{
+		uint64_t index = 0;
+		// everything between two update calls, including work outside cameras
+		counters work = {};
+		double cpu_ms = 0;
+		// sum of the gpu timed passes
+		double gpu_ms = 0;
+		std::vector<camera_pass> cameras = {};
+	};
+
+	inline const size_t HISTORY_SIZE = 240;
+
+	// closes the frame, it joins the history once its timer queries resolve (usually a few frames later). call once per frame
+	void update();
+	// GL_EXT_disjoint_timer_query on gles, core on desktop gl
+	bool gpu_timer_supported();
+	// resolved frames, oldest first, at most HISTORY_SIZE
+	std::span<const frame> history();
+	// newest resolved frame, empty until the first one resolves
+	const frame& latest();
+}
+
 namespace imr::sprite
 {
 	result begin_try_batch();
@@ -371,9 +565,24 @@ namespace imr::sprite
 		float rotation = {};
 		float4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
 		float2 offset = {};
+		// order between begin_layered and end_layered, layer first (int16 range) then depth
+		int layer = 0;
+		float depth = 0;
 	};
 	result draw(const draw_args& args);
 	result end_try_batch();
+
+	struct layered_args
+	{
+		// depth is position.y, lower sprites are drawn over upper ones. the y order interleaves materials,
+		// so only neighbours in y that share a material batch; keep y sorted sprites on their own layers
+		bool y_sort = false;
+	};
+	// sprites are collected until end_layered, sorted by (layer, depth, material) and drawn in the fewest instanced draws.
+	// equal keys keep submission order. a layer outside int16 or a 65537th material fails the draw,
+	// and camera::end draws a range that is still open
+	result begin_layered(const layered_args& args = {});
+	result end_layered();
 	result draw_single(Itexture_info* tex_info, const float2& position, const float2& scale = { 1, 1 }, float rotation = 0, const float4& color = { 1, 1, 1, 1 }, const float2& offset = {});
 }
 
@@ -385,21 +594,65 @@ namespace imr::instancing
 		const Itexture_info* texture_info_1 = {};
 		const Itexture_info* texture_info_2 = {};
 		const Itexture_info* texture_info_3 = {};
+		// 32 byte quantized instances (half float transform, unorm16 uv, rgba8 color), ignored while a program is pushed.
+		// the transform is exact to a quarter pixel below 512 pixels of scaled size and to a pixel below 2048, larger sprites want the full format
+		bool compact = false;
 	};
 	struct instance_args
 	{
 		const atlas_info::sprite_info* sprite_info = {};
+		// another page of the begun texture array, drawn whole unless sprite_info is given
+		const Itexture_info* texture_info = {};
 		float2 position = {};
 		float2 scale = { 1.0f, 1.0f };
 		float rotation = {};
 		float4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
 		float2 offset = {};
 	};
+	// structure of arrays input, optional spans may be empty and default to instance_args values
+	struct instance_many_args
+	{
+		std::span<const float2> positions = {};
+		std::span<const float2> scales = {};
+		std::span<const float> rotations = {};
+		std::span<const float4> colors = {};
+		std::span<const int> sprite_indices = {}; // index into sprites
+		std::span<const atlas_info::sprite_info* const> sprites = {};
+	};
+	class sub_stream;
+	// fills count items from the thread pool, fill(stream, first, last) may add at most one instance per item.
+	// the slices of every worker are joined into the current instancing level before returning.
+	result instance_parallel(size_t count, const std::function<void(sub_stream& stream, size_t first, size_t last)>& fill);
+
+	// slice of the current instancing level's staging owned by one worker of instance_parallel
+	class sub_stream
+	{
+	public:
+		result instance(const instance_args& args);
+		int size() const { return _count; }
+
+	private:
+		friend result instance_parallel(size_t count, const std::function<void(sub_stream& stream, size_t first, size_t last)>& fill);
+		float* _data = {};
+		int _capacity = 0;
+		int _count = 0;
+		bool _compact = false;
+		const Itexture_info* _texture = {};
+		float2 _texture_size = {};
+		float4 _uv_rect = {};
+		float _layer = 0;
+		const float4* _cull_rect = {};
+		size_t _culled = 0;
+	};
+
 	result begin(const begin_args& args);
 	result instance(const instance_args& args);
+	result instance_many(const instance_many_args& args);
 	result begin(const Itexture_info* texture, const Itexture_info* texture_1 = nullptr, const Itexture_info* texture_2 = nullptr, Itexture_info* texture_3 = nullptr);
 	result instance(const float2& sprite_pos, const float2& sprite_size, const float2& offset, const float2& position, const float2& scale = { 1, 1 }, const float rotation = 0, const float4& color = { 1, 1, 1, 1 });
 	result end();
+	// bytes reserved by instance staging of every stack level
+	size_t staging_memory_size();
 }
 
 namespace imr::blend
@@ -427,8 +680,11 @@ namespace imr::mesh
 
 	result begin();
 	result use_program(const std::string& name);
+	result use_program(program_handle handle);
 	result set_use_projection_view_matrix(bool val);
+	// indices are rebased onto the vertices already pushed, a mesh past 65536 vertices is drawn with 32 bit indices
 	result push_meshes(const float* vertices, int v_stride, size_t v_cnt, const unsigned short* indices, size_t i_cnt);
+	result push_meshes(const float* vertices, int v_stride, size_t v_cnt, const uint32_t* indices, size_t i_cnt);
 	result set_uniform_mat4(int location, const float* data, int length);
 	result set_uniform_vec4(int location, const float* data, int length);
 	result set_texture(int location, Itexture_info* texture);
@@ -445,18 +701,104 @@ namespace imr::primitive
 		float thickness = 1.0f;
 		float4 color = { 1, 1, 1, 1 };
 	};
+	// a ring of thickness centered on radius, or a disc when filled
 	struct circle_args
 	{
 		float2 center = {};
 		float radius = 50.0f;
 		float thickness = 1.0f;
 		float4 color = { 1, 1, 1, 1 };
-		int segment = 10;
+		bool filled = false;
+	};
+	struct rect_args
+	{
+		float2 center = {};
+		float2 size = {};
+		// degrees
+		float rotation = {};
+		float corner_radius = {};
+		float thickness = 1.0f;
+		float4 color = { 1, 1, 1, 1 };
+		bool filled = false;
+	};
+	// line with round caps
+	struct capsule_args
+	{
+		float2 from = {};
+		float2 to = {};
+		float radius = 1.0f;
+		float thickness = 1.0f;
+		float4 color = { 1, 1, 1, 1 };
+		bool filled = false;
+	};
+	enum class join_type
+	{
+		miter,
+		round,
+	};
+	// a simple polygon of either winding, filled or stroked along its closed outline.
+	// a stroked outline overlaps at corners like polyline_args
+	struct polygon_args
+	{
+		std::span<const float2> points = {};
+		bool filled = true;
+		float thickness = 1.0f;
+		join_type join = join_type::miter;
+		float4 color = { 1, 1, 1, 1 };
+		// reuse the tessellation while points and style stay the same, for static geometry
+		bool cache = false;
+	};
+	struct polyline_args
+	{
+		std::span<const float2> points = {};
+		bool closed = false;
+		float thickness = 1.0f;
+		// round joins also round the ends of an open line
+		join_type join = join_type::miter;
+		// strokes overlap themselves at corners, a translucent color shows darker joins there.
+		// draw opaque into a render target and composite it with alpha for an even result
+		float4 color = { 1, 1, 1, 1 };
+		bool cache = false;
 	};
+	// every shape is one instance, its edge is antialiased from the signed distance in the fragment shader
 	result begin();
 	result line(const line_args& args);
 	result circle(const circle_args& args);
+	result rect(const rect_args& args);
+	result capsule(const capsule_args& args);
+	// tessellated and drawn through imr::mesh, neighbouring polygons and polylines merge into one draw
+	result polygon(const polygon_args& args);
+	result polyline(const polyline_args& args);
+	void clear_shape_cache();
+	result end();
+}
+
+// static content (floors, walls, decor) rendered once into a pooled target and drawn as one textured quad after that.
+//	if (auto [ret, record] = imr::layer_cache::begin({ .name = "floor" }); succeed(ret))
+//	{
+//		if (record) { draw the layer }
+//		imr::layer_cache::end();
+//	}
+namespace imr::layer_cache
+{
+	struct begin_args
+	{
+		// identifies the cache, must not be empty
+		std::string_view name = {};
+		// world region to keep, empty caches the camera view grown by margin and records again once the view leaves it
+		float4 world_rect = {};
+		float margin = 256.0f;
+	};
+	// needs a camera. record is true when the layer has to be drawn again, draws until end then go into the cache.
+	// otherwise the cached quad is already drawn. call end whenever ret succeeded
+	std::tuple<result, bool> begin(const begin_args& args);
 	result end();
+	// the next begin records the layer again, the target is kept for it
+	void invalidate(std::string_view name);
+	void invalidate_all();
+	// gives the target back to the render target pool
+	void release(std::string_view name);
+	void release_all();
 }
 
 namespace imr::input
@@ -0,0 +1,232 @@
+#include "imr_tessellate.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+	using imr::float2;
+	using imr::float4;
+
+	const float PI = 3.14159265358979f;
+	// a round join or cap gets a vertex at least every 22.5 degrees
+	const float ROUND_STEP = PI / 8.0f;
+
+	float cross(const float2& a, const float2& b) { return a.x * b.y - a.y * b.x; }
+	float dot(const float2& a, const float2& b) { return a.x * b.x + a.y * b.y; }
+	float2 left(const float2& d) { return { -d.y, d.x }; }
+
+	// repeated points (and a closing point equal to the first) would make zero length segments
+	std::vector<float2> unique_points(std::span<const float2> points, bool closed)
+	{
+		std::vector<float2> ret = {};
+		ret.reserve(points.size());
+		for (auto& p : points)
+		{
+			if (ret.empty() || imr::length(p - ret.back()) > 1e-4f)
+			{
+				ret.push_back(p);
+			}
+		}
+		while (closed && ret.size() > 1 && imr::length(ret.front() - ret.back()) <= 1e-4f)
+		{
+			ret.pop_back();
+		}
+		return ret;
+	}
+
+	bool inside_triangle(const float2& p, const float2& a, const float2& b, const float2& c, float winding)
+	{
+		return cross(b - a, p - a) * winding >= 0 && cross(c - b, p - b) * winding >= 0 && cross(a - c, p - c) * winding >= 0;
+	}
+
+	struct mesh_writer
+	{
+		imr::mesh::draw_args& out;
+		float4 color = {};
+
+		unsigned short vertex(const float2& position)
+		{
+			out.vertices.push_back({ .position = position, .uv = { 0.5f, 0.5f }, .color = color });
+			return static_cast<unsigned short>(out.vertices.size() - 1);
+		}
+
+		void triangle(unsigned short a, unsigned short b, unsigned short c)
+		{
+			out.indices.insert(out.indices.end(), { a, b, c });
+		}
+
+		// fan around center sweeping the offset from by angle radians
+		void arc(const float2& center, const float2& from, float angle)
+		{
+			int steps = std::max(1, static_cast<int>(std::ceil(std::abs(angle) / ROUND_STEP)));
+			auto c = vertex(center);
+			auto prev = vertex(center + from);
+			for (int i = 1; i <= steps; ++i)
+			{
+				float2 offset = from;
+				auto next = vertex(center + offset.rotate(angle * i / steps));
+				triangle(c, prev, next);
+				prev = next;
+			}
+		}
+	};
+}
+
+namespace imr::tessellate
+{
+	bool fill(std::span<const float2> points, const float4& color, imr::mesh::draw_args& out)
+	{
+		auto p = unique_points(points, true);
+		if (p.size() < 3 || out.vertices.size() + p.size() > 0x10000)
+		{
+			return false;
+		}
+		float area = 0;
+		for (size_t i = 0; i < p.size(); ++i)
+		{
+			area += cross(p[i], p[(i + 1) % p.size()]);
+		}
+		if (std::abs(area) < 1e-6f)
+		{
+			return false;
+		}
+		// convex corners turn the same way as the outline
+		const float winding = area > 0 ? 1.0f : -1.0f;
+
+		mesh_writer writer = { .out = out, .color = color };
+		const auto base = writer.vertex(p[0]);
+		for (size_t i = 1; i < p.size(); ++i)
+		{
+			writer.vertex(p[i]);
+		}
+
+		std::vector<int> remaining(p.size());
+		std::iota(remaining.begin(), remaining.end(), 0);
+		while (remaining.size() > 3)
+		{
+			const size_t m = remaining.size();
+			size_t ear = m;
+			for (size_t i = 0; i < m && ear == m; ++i)
+			{
+				int a = remaining[(i + m - 1) % m];
+				int b = remaining[i];
+				int c = remaining[(i + 1) % m];
+				if (cross(p[b] - p[a], p[c] - p[b]) * winding <= 0)
+				{
+					continue;
+				}
+				bool empty = true;
+				for (int j : remaining)
+				{
+					if (j != a && j != b && j != c && inside_triangle(p[j], p[a], p[b], p[c], winding))
+					{
+						empty = false;
+						break;
+					}
+				}
+				if (empty)
+				{
+					ear = i;
+				}
+			}
+			// only collinear or self intersecting leftovers have no ear, clip anyway so the loop ends
+			if (ear == m)
+			{
+				ear = 0;
+			}
+			writer.triangle(
+				static_cast<unsigned short>(base + remaining[(ear + m - 1) % m]),
+				static_cast<unsigned short>(base + remaining[ear]),
+				static_cast<unsigned short>(base + remaining[(ear + 1) % m]));
+			remaining.erase(remaining.begin() + ear);
+		}
+		writer.triangle(
+			static_cast<unsigned short>(base + remaining[0]),
+			static_cast<unsigned short>(base + remaining[1]),
+			static_cast<unsigned short>(base + remaining[2]));
+		return true;
+	}
+
+	bool stroke(std::span<const float2> points, bool closed, float thickness, imr::primitive::join_type join, const float4& color, imr::mesh::draw_args& out)
+	{
+		auto p = unique_points(points, closed);
+		const size_t n = p.size();
+		if (n < 2 || thickness <= 0)
+		{
+			return false;
+		}
+		closed = closed && n > 2;
+		const float hw = thickness * 0.5f;
+		const size_t first_vertex = out.vertices.size();
+		const size_t first_index = out.indices.size();
+		auto dir = [&](size_t i) { return (p[(i + 1) % n] - p[i]).normalize(); };
+
+		mesh_writer writer = { .out = out, .color = color };
+		for (size_t i = 0; i < (closed ? n : n - 1); ++i)
+		{
+			auto a = p[i];
+			auto b = p[(i + 1) % n];
+			auto offset = left(dir(i)) * hw;
+			auto v0 = writer.vertex(a + offset);
+			auto v1 = writer.vertex(a - offset);
+			auto v2 = writer.vertex(b - offset);
+			auto v3 = writer.vertex(b + offset);
+			writer.triangle(v0, v1, v2);
+			writer.triangle(v0, v2, v3);
+		}
+
+		// segment quads overlap on the inner side of a corner, the join fills the gap on the outer one
+		for (size_t k = closed ? 0 : 1; k < (closed ? n : n - 1); ++k)
+		{
+			auto d0 = dir((k + n - 1) % n);
+			auto d1 = dir(k);
+			float turn = cross(d0, d1);
+			if (std::abs(turn) < 1e-6f && dot(d0, d1) > 0)
+			{
+				continue;
+			}
+			float side = turn > 0 ? -1.0f : 1.0f;
+			auto n0 = left(d0) * (hw * side);
+			auto n1 = left(d1) * (hw * side);
+			auto& c = p[k];
+			if (join == imr::primitive::join_type::round)
+			{
+				writer.arc(c, n0, std::atan2(cross(n0, n1), dot(n0, n1)));
+				continue;
+			}
+
+			auto m = n0 + n1;
+			float m_length = imr::length(m);
+			float miter = m_length > 1e-6f ? hw * hw / dot(m / m_length, n0) : 0;
+			auto vc = writer.vertex(c);
+			auto v0 = writer.vertex(c + n0);
+			auto v1 = writer.vertex(c + n1);
+			if (m_length > 1e-6f && miter <= MITER_LIMIT * hw)
+			{
+				auto tip = writer.vertex(c + m / m_length * miter);
+				writer.triangle(vc, v0, tip);
+				writer.triangle(vc, tip, v1);
+			}
+			else
+			{
+				writer.triangle(vc, v0, v1);
+			}
+		}
+
+		if (closed == false && join == imr::primitive::join_type::round)
+		{
+			// half discs past both ends
+			writer.arc(p[0], left(dir(0)) * hw, PI);
+			writer.arc(p[n - 1], left(dir(n - 2)) * -hw, PI);
+		}
+
+		if (out.vertices.size() > 0x10000)
+		{
+			out.vertices.resize(first_vertex);
+			out.indices.resize(first_index);
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "imr_core.h"
+
+namespace imr::tessellate
+{
+	// longest miter in half thicknesses before a corner is beveled
+	inline const float MITER_LIMIT = 4.0f;
+
+	// ear clipping of a simple polygon of either winding, appended to out.
+	// false when there is no area or the vertices don't fit 16 bit indices
+	bool fill(std::span<const float2> points, const float4& color, imr::mesh::draw_args& out);
+
+	// a quad per segment and a join at every corner, appended to out.
+	// the pieces overlap at corners, so a translucent color blends twice there
+	bool stroke(std::span<const float2> points, bool closed, float thickness, imr::primitive::join_type join, const float4& color, imr::mesh::draw_args& out);
+}
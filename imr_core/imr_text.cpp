@@ -20,12 +20,12 @@ namespace imr::text
 
 		if (FT_Init_FreeType(&this->_ft))
 		{
-			return {};
+			return { .type = fail, .error_code = 1, .msg = "fail to init freetype" };
 		}
 
 		if (FT_New_Face(this->_ft, path, 0, &this->_face))
 		{
-			return {};
+			return { .type = fail, .error_code = 2, .msg = "fail to load the font" };
 		}
 		FT_Set_Pixel_Sizes(this->_face, font_width, font_height);
 
@@ -34,8 +34,8 @@ namespace imr::text
 		this->_width = packer_width;
 		this->_height = packer_height;
 		this->_packer.Init(packer_width, packer_height, false);
-		this->_frame = std::make_shared<frame_buffer>();
-		this->_frame->create(this->_width, this->_height);
+		// glyphs only need color
+		this->_frame = imr::acquire_render_target({ .width = static_cast<int>(this->_width), .height = static_cast<int>(this->_height) });
 		this->_frame_texture_info = frame_buffer_texture_info(this->_frame);
 		if (succeed(imr::camera::begin({ .frame_buffer = this->_frame.get() })))
 		{
@@ -65,7 +65,7 @@ namespace imr::text
 		auto& ret = _characters[c];
 		ret.tex_coords = { rect.x + margin, rect.y + margin, rect.width, rect.height };
 		ret.bearing = { _face->glyph->bitmap_left, _face->glyph->bitmap_top };
-		ret.advance = { static_cast<float>(_face->glyph->advance.x >> 6), static_cast<float>(_face->glyph->advance.y >> 6) };
+		ret.advance = float2(static_cast<float>(_face->glyph->advance.x >> 6), static_cast<float>(_face->glyph->advance.y >> 6));
 
 		// draw to frame
 		if (_face->glyph->bitmap.width > 0 && _face->glyph->bitmap.rows > 0)
@@ -75,7 +75,7 @@ namespace imr::text
 			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 			unsigned int texture;
 			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_2D, texture);
+			CTX->gl_state.bind_texture(GL_TEXTURE_2D, texture);
 			glTexImage2D(
 				GL_TEXTURE_2D,
 				0,
@@ -87,6 +87,7 @@ namespace imr::text
 				GL_UNSIGNED_BYTE,
 				_face->glyph->bitmap.buffer
 			);
+			CTX->gl_state.counters.upload_bytes += static_cast<size_t>(_face->glyph->bitmap.width) * _face->glyph->bitmap.rows;
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -114,6 +115,9 @@ namespace imr::text
 	{
 		FT_Done_Face(_face);
 		FT_Done_FreeType(_ft);
+		// the atlas target goes back to the render target pool
+		_frame_texture_info = frame_buffer_texture_info(nullptr);
+		_frame.reset();
 	}
 
 	result begin(font_info* font)
@@ -136,7 +140,7 @@ namespace imr::text
 		}
 		auto& state = CTX->text_stack.top();
 
-		imr::push_program(TEXT_PROGRAM_NAME);
+		imr::push_program(CTX->builtin_programs.text);
 		if (succeed(imr::instancing::begin(state.font_info->get_frame_buffer_texture())))
 		{
 			float2 pos = position;
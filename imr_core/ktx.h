@@ -0,0 +1,120 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace imr::ktx
+{
+	// KTX 1.1 container for pre-compressed textures, written by imr_texconv and read by load_texture
+	inline const uint8_t IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	inline const uint32_t ENDIANNESS = 0x04030201;
+
+	// gl enums spelled out so the converter doesn't need gl headers
+	inline const uint32_t COMPRESSED_R11_EAC = 0x9270;
+	inline const uint32_t COMPRESSED_SIGNED_R11_EAC = 0x9271;
+	inline const uint32_t COMPRESSED_RG11_EAC = 0x9272;
+	inline const uint32_t COMPRESSED_SIGNED_RG11_EAC = 0x9273;
+	inline const uint32_t COMPRESSED_RGB8_ETC2 = 0x9274;
+	inline const uint32_t COMPRESSED_SRGB8_ETC2 = 0x9275;
+	inline const uint32_t COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2 = 0x9276;
+	inline const uint32_t COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2 = 0x9277;
+	inline const uint32_t COMPRESSED_RGBA8_ETC2_EAC = 0x9278;
+	inline const uint32_t COMPRESSED_SRGB8_ALPHA8_ETC2_EAC = 0x9279;
+	inline const uint32_t BASE_RGB = 0x1907;
+	inline const uint32_t BASE_RGBA = 0x1908;
+
+	struct header
+	{
+		uint8_t identifier[12] = {};
+		uint32_t endianness = ENDIANNESS;
+		uint32_t gl_type = 0;
+		uint32_t gl_type_size = 1;
+		uint32_t gl_format = 0;
+		uint32_t gl_internal_format = 0;
+		uint32_t gl_base_internal_format = 0;
+		uint32_t pixel_width = 0;
+		uint32_t pixel_height = 0;
+		uint32_t pixel_depth = 0;
+		uint32_t array_element_count = 0;
+		uint32_t face_count = 1;
+		uint32_t mipmap_level_count = 1;
+		uint32_t key_value_bytes = 0;
+	};
+	static_assert(sizeof(header) == 64);
+
+	struct level
+	{
+		const uint8_t* data = {};
+		uint32_t size = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	struct image
+	{
+		header head = {};
+		std::vector<level> levels = {};
+	};
+
+	inline bool is_ktx(const void* data, size_t size)
+	{
+		return size >= sizeof(header) && memcmp(data, IDENTIFIER, sizeof(IDENTIFIER)) == 0;
+	}
+
+	// the etc2 and eac formats, core in gles3 and gl 4.3 (ARB_ES3_compatibility). nothing else is uploaded
+	inline bool is_etc2_format(uint32_t gl_internal_format)
+	{
+		return gl_internal_format >= COMPRESSED_R11_EAC && gl_internal_format <= COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+	}
+
+	// views of every mip level inside data, false if the file is not a little endian 2d etc2 or eac texture
+	inline bool parse(const void* data, size_t size, image& out)
+	{
+		if (is_ktx(data, size) == false)
+		{
+			return false;
+		}
+		memcpy(&out.head, data, sizeof(header));
+		auto& head = out.head;
+		if (head.endianness != ENDIANNESS || head.gl_type != 0 || head.pixel_depth > 1 || head.array_element_count > 0 || head.face_count != 1
+			|| is_etc2_format(head.gl_internal_format) == false)
+		{
+			return false;
+		}
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		size_t offset = sizeof(header) + head.key_value_bytes;
+		int width = static_cast<int>(head.pixel_width);
+		int height = static_cast<int>(head.pixel_height);
+		out.levels.clear();
+		for (uint32_t i = 0; i < (head.mipmap_level_count > 0 ? head.mipmap_level_count : 1); ++i)
+		{
+			uint32_t level_size = 0;
+			if (offset + sizeof(level_size) > size)
+			{
+				return false;
+			}
+			memcpy(&level_size, bytes + offset, sizeof(level_size));
+			offset += sizeof(level_size);
+			if (offset + level_size > size)
+			{
+				return false;
+			}
+			out.levels.push_back({ bytes + offset, level_size, width, height });
+			offset += (level_size + 3) & ~3u;
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+		return true;
+	}
+
+	// appends a level to a file being written, the header must already be in out
+	inline void write_level(std::vector<uint8_t>& out, const std::vector<uint8_t>& data)
+	{
+		uint32_t level_size = static_cast<uint32_t>(data.size());
+		const uint8_t* size_bytes = reinterpret_cast<const uint8_t*>(&level_size);
+		out.insert(out.end(), size_bytes, size_bytes + sizeof(level_size));
+		out.insert(out.end(), data.begin(), data.end());
+		out.resize((out.size() + 3) & ~size_t(3));
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace imr
+{
+	struct sort_item
+	{
+		uint64_t key = 0;
+		uint32_t value = 0;
+	};
+
+	// maps float order to unsigned order
+	inline uint32_t sortable_float(float value)
+	{
+		uint32_t bits = 0;
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	}
+
+	// stable lsd radix sort by key, 8 bits per pass. passes where every key has the same byte are skipped
+	inline void radix_sort(std::vector<sort_item>& items, std::vector<sort_item>& scratch)
+	{
+		const size_t count = items.size();
+		if (count < 2)
+		{
+			return;
+		}
+		scratch.resize(count);
+
+		const int PASS_COUNT = 8;
+		size_t histograms[PASS_COUNT][256] = {};
+		for (auto& item : items)
+		{
+			for (int pass = 0; pass < PASS_COUNT; ++pass)
+			{
+				histograms[pass][(item.key >> (pass * 8)) & 0xff]++;
+			}
+		}
+
+		sort_item* src = items.data();
+		sort_item* dst = scratch.data();
+		for (int pass = 0; pass < PASS_COUNT; ++pass)
+		{
+			const int shift = pass * 8;
+			auto& histogram = histograms[pass];
+			if (histogram[(src[0].key >> shift) & 0xff] == count)
+			{
+				continue;
+			}
+			size_t offset = 0;
+			for (auto& bucket : histogram)
+			{
+				size_t bucket_count = bucket;
+				bucket = offset;
+				offset += bucket_count;
+			}
+			for (size_t i = 0; i < count; ++i)
+			{
+				dst[histogram[(src[i].key >> shift) & 0xff]++] = src[i];
+			}
+			std::swap(src, dst);
+		}
+		if (src != items.data())
+		{
+			items.swap(scratch);
+		}
+	}
+}
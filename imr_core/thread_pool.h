@@ -0,0 +1,237 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <utility>
+#include "imr_core.h"
+
+namespace imr
+{
+	// fixed set of workers for fork/join jobs issued from one thread
+	class thread_pool
+	{
+	public:
+		explicit thread_pool(size_t thread_count)
+		{
+			for (size_t i = 0; i < thread_count; ++i)
+			{
+				_threads.emplace_back([this]() { work(); });
+			}
+		}
+
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_quit = true;
+			}
+			_wake.notify_all();
+			for (auto& t : _threads)
+			{
+				t.join();
+			}
+		}
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		// number of workers, the calling thread of parallel_for works as well
+		size_t size() const { return _threads.size(); }
+
+		// runs job(i) for every i in [0, count) and returns when all of them finished
+		void parallel_for(size_t count, const std::function<void(size_t)>& job)
+		{
+			if (count == 0)
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_job = &job;
+				_count = count;
+				_next = 0;
+				_finished = 0;
+				_generation++;
+			}
+			_wake.notify_all();
+
+			run_jobs(job, count);
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_done.wait(lock, [this]() { return _finished == _count && _active == 0; });
+			_job = {};
+			// the first exception of any job is rethrown on the calling thread
+			if (_error)
+			{
+				std::rethrow_exception(std::exchange(_error, nullptr));
+			}
+		}
+
+	private:
+		void run_jobs(const std::function<void(size_t)>& job, size_t count)
+		{
+			size_t finished = 0;
+			std::exception_ptr error = {};
+			for (size_t i = _next++; i < count; i = _next++)
+			{
+				try
+				{
+					job(i);
+				}
+				catch (...)
+				{
+					if (error == nullptr)
+					{
+						error = std::current_exception();
+					}
+				}
+				finished++;
+			}
+			if (finished > 0)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_finished += finished;
+				if (_error == nullptr)
+				{
+					_error = error;
+				}
+			}
+			_done.notify_all();
+		}
+
+		void work()
+		{
+			uint64_t generation = 0;
+			while (true)
+			{
+				const std::function<void(size_t)>* job = {};
+				size_t count = 0;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [&]() { return _quit || (_job && _generation != generation); });
+					if (_quit)
+					{
+						return;
+					}
+					generation = _generation;
+					job = _job;
+					count = _count;
+					_active++;
+				}
+				run_jobs(*job, count);
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_active--;
+				}
+				_done.notify_all();
+			}
+		}
+
+		std::vector<std::thread> _threads = {};
+		std::mutex _mutex = {};
+		std::condition_variable _wake = {};
+		std::condition_variable _done = {};
+		const std::function<void(size_t)>* _job = {};
+		size_t _count = 0;
+		std::atomic<size_t> _next = 0;
+		size_t _finished = 0;
+		std::exception_ptr _error = {};
+		size_t _active = 0;
+		uint64_t _generation = 0;
+		bool _quit = false;
+	};
+
+	// workers running pushed jobs in the background, in order of arrival. jobs not started at destruction are dropped.
+	// done gets the result of its job on the worker thread, an exception escaping the job arrives there as a failed result
+	class task_queue
+	{
+	public:
+		explicit task_queue(size_t thread_count)
+		{
+			for (size_t i = 0; i < thread_count; ++i)
+			{
+				_threads.emplace_back([this]() { work(); });
+			}
+		}
+
+		~task_queue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_quit = true;
+				_jobs.clear();
+			}
+			_wake.notify_all();
+			for (auto& t : _threads)
+			{
+				t.join();
+			}
+		}
+
+		task_queue(const task_queue&) = delete;
+		task_queue& operator=(const task_queue&) = delete;
+
+		void push(std::function<result()> job, std::function<void(const result&)> done = {})
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_jobs.push_back({ std::move(job), std::move(done) });
+			}
+			_wake.notify_one();
+		}
+
+	private:
+		void work()
+		{
+			while (true)
+			{
+				task job = {};
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [this]() { return _quit || _jobs.empty() == false; });
+					if (_quit)
+					{
+						return;
+					}
+					job = std::move(_jobs.front());
+					_jobs.pop_front();
+				}
+				result ret = {};
+				try
+				{
+					ret = job.run();
+				}
+				catch (const std::exception& e)
+				{
+					ret = { .type = result_type::fail, .error_code = 1, .msg = e.what() };
+				}
+				catch (...)
+				{
+					ret = { .type = result_type::fail, .error_code = 1, .msg = "unknown exception in task" };
+				}
+				if (job.done)
+				{
+					job.done(ret);
+				}
+			}
+		}
+
+		struct task
+		{
+			std::function<result()> run = {};
+			std::function<void(const result&)> done = {};
+		};
+
+		std::vector<std::thread> _threads = {};
+		std::mutex _mutex = {};
+		std::condition_variable _wake = {};
+		std::deque<task> _jobs = {};
+		bool _quit = false;
+	};
+}
@@ -28,9 +28,9 @@ namespace tweeners
 		{ "easeInQuint", [](float t) { float t2 = t * t; return t * t2 * t2; } },
 		{ "easeOutQuint", [](float t) { float t2 = (--t) * t; return 1 + t * t2 * t2; } },
 		{ "easeInOutQuint", [](float t) { float t2; if (t < 0.5f) { t2 = t * t; return 16 * t * t2 * t2; } else { t2 = (--t) * t; return 1 + 16 * t * t2 * t2; }} },
-		{ "easeInExpo", [](float t) { return (std::powf(2, 8 * t) - 1) / 255; } },
-		{ "easeOutExpo", [](float t) { return 1 - std::powf(2, -8 * t); } },
-		{ "easeInOutExpo", [](float t) { if (t < 0.5f) { return (std::powf(2, 16 * t) - 1) / 510; } else { return 1 - 0.5f * std::powf(2, -16 * (t - 0.5f)); }} },
+		{ "easeInExpo", [](float t) { return (std::pow(2.0f, 8 * t) - 1) / 255; } },
+		{ "easeOutExpo", [](float t) { return 1 - std::pow(2.0f, -8 * t); } },
+		{ "easeInOutExpo", [](float t) { if (t < 0.5f) { return (std::pow(2.0f, 16 * t) - 1) / 510; } else { return 1 - 0.5f * std::pow(2.0f, -16 * (t - 0.5f)); }} },
 		{ "easeInCirc", [](float t) { return 1 - sqrt(1 - t); } },
 		{ "easeOutCirc", [](float t) { return sqrt(t); } },
 		{ "easeInOutCirc", [](float t) { if (t < 0.5f) { return (1 - sqrt(1 - 2 * t)) * 0.5f; } else { return (1 + sqrt(2 * t - 1)) * 0.5f; }} },
@@ -40,9 +40,9 @@ namespace tweeners
 		{ "easeInElastic", [](float t) { float t2 = t * t; return t2 * t2 * std::sin(t * __PI__ * 4.5f); } },
 		{ "easeOutElastic", [](float t) { float t2 = (t - 1) * (t - 1); return 1 - t2 * t2 * cos(t * __PI__ * 4.5f); } },
 		{ "easeInOutElastic", [](float t) { float t2; if (t < 0.45f) { t2 = t * t; return 8 * t2 * t2 * std::sin(t * __PI__ * 9); } else if (t < 0.55f) { return 0.5f + 0.75f * std::sin(t * __PI__ * 4); } else { t2 = (t - 1) * (t - 1); return 1 - 8 * t2 * t2 * std::sin(t * __PI__ * 9); }} },
-		{ "easeInBounce", [](float t) { return std::powf(2, 6 * (t - 1)) * abs(std::sin(t * __PI__ * 3.5f)); } },
-		{ "easeOutBounce", [](float t) { return 1 - std::powf(2, -6 * t) * abs(cos(t * __PI__ * 3.5f)); } },
-		{ "easeInOutBounce", [](float t) { if (t < 0.5f) { return 8 * std::powf(2, 8 * (t - 1)) * abs(std::sin(t * __PI__ * 7)); } else { return 1 - 8 * std::powf(2, -8 * t) * abs(std::sin(t * __PI__ * 7)); }} },
+		{ "easeInBounce", [](float t) { return std::pow(2.0f, 6 * (t - 1)) * std::abs(std::sin(t * __PI__ * 3.5f)); } },
+		{ "easeOutBounce", [](float t) { return 1 - std::pow(2.0f, -6 * t) * std::abs(cos(t * __PI__ * 3.5f)); } },
+		{ "easeInOutBounce", [](float t) { if (t < 0.5f) { return 8 * std::pow(2.0f, 8 * (t - 1)) * std::abs(std::sin(t * __PI__ * 7)); } else { return 1 - 8 * std::pow(2.0f, -8 * t) * std::abs(std::sin(t * __PI__ * 7)); }} },
 	};
 
 	template<class T>
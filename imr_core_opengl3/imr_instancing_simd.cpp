@@ -0,0 +1,329 @@
+#include "imr_opengl3.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMR_SIMD_SSE2
+#include <immintrin.h>
+// the avx2 kernel is picked at run time, so neither the vcxproj nor cmake has to build for avx2
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define IMR_TARGET_AVX2
+#else
+#define IMR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+	const float DEG_TO_RAD = glm::pi<float>() / 180.0f;
+	const imr::float4 DEFAULT_COLOR = { 1, 1, 1, 1 };
+	const imr::float2 DEFAULT_SCALE = { 1, 1 };
+	const imr::float2 DEFAULT_OFFSET = {};
+
+	// radians of rotations[first, first + count), 8 at a time
+	const int BLOCK_SIZE = 8;
+	void to_radians(float* dst, const imr::instancing::instance_many_args& args, const uint32_t* indices, size_t first, size_t count)
+	{
+		if (args.rotations.empty())
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				dst[i] = 0;
+			}
+			return;
+		}
+		if (indices)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				dst[i] = args.rotations[indices[first + i]] * DEG_TO_RAD;
+			}
+			return;
+		}
+		const float* src = args.rotations.data() + first;
+#if defined(IMR_SIMD_SSE2)
+		if (count == BLOCK_SIZE)
+		{
+			auto k = _mm_set1_ps(DEG_TO_RAD);
+			_mm_storeu_ps(dst, _mm_mul_ps(_mm_loadu_ps(src), k));
+			_mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_loadu_ps(src + 4), k));
+			return;
+		}
+#endif
+		for (size_t i = 0; i < count; ++i)
+		{
+			dst[i] = src[i] * DEG_TO_RAD;
+		}
+	}
+}
+
+#if defined(IMR_SIMD_SSE2)
+namespace
+{
+	// the five 4 float groups of one instance
+	struct instance_groups
+	{
+		__m128 translate_scale;
+		__m128 rotation_size;
+		__m128 uv_rect;
+		__m128 color;
+		__m128 offset;
+	};
+
+	inline void load_groups(instance_groups& out, const imr::instancing::instance_many_args& args, size_t i, float radian, __m128 default_size, __m128 default_uv)
+	{
+		const imr::float2& scale = args.scales.empty() ? DEFAULT_SCALE : args.scales[i];
+		const imr::float4& color = args.colors.empty() ? DEFAULT_COLOR : args.colors[i];
+
+		auto translate_scale = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(&args.positions[i]));
+		out.translate_scale = _mm_loadh_pi(translate_scale, reinterpret_cast<const __m64*>(&scale));
+		out.color = _mm_loadu_ps(color.value);
+		// (offset x, offset y, normal map sign, 0)
+		const __m128 normal_sign = _mm_setr_ps(0, 0, scale.x < 0 ? -1.0f : 1.0f, 0);
+
+		__m128 size = default_size;
+		if (args.sprite_indices.empty() == false)
+		{
+			auto* sprite = args.sprites[args.sprite_indices[i]];
+			// (w, h, 0, 0) -> (0, w, h, 0), then the sprite's page in lane 3
+			size = _mm_cvtepi32_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&sprite->size)));
+			size = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(size), 4));
+			size = _mm_or_ps(size, _mm_setr_ps(0, 0, 0, sprite->layer));
+			out.uv_rect = _mm_loadu_ps(sprite->uv_rect.value);
+			out.offset = _mm_loadl_pi(normal_sign, reinterpret_cast<const __m64*>(&sprite->offset));
+		}
+		else
+		{
+			out.uv_rect = default_uv;
+			out.offset = normal_sign;
+		}
+		out.rotation_size = _mm_move_ss(size, _mm_set_ss(radian));
+	}
+
+	bool cpu_has_avx2()
+	{
+#if defined(_MSC_VER)
+		int info[4] = {};
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		// the os has to save the ymm registers too
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+	const bool HAS_AVX2 = cpu_has_avx2();
+
+	void pack_instances_sse2(float* dst, const imr::instancing::instance_many_args& args, const uint32_t* indices, size_t first, size_t count, const imr::float2& texture_size, const imr::float4& texture_uv, float layer)
+	{
+		float radians[BLOCK_SIZE] = {};
+		// (0, w, h, layer)
+		const __m128 default_size = _mm_setr_ps(0, texture_size.x, texture_size.y, layer);
+		const __m128 default_uv = _mm_loadu_ps(texture_uv.value);
+		for (size_t block = 0; block < count; block += BLOCK_SIZE)
+		{
+			size_t block_count = std::min<size_t>(BLOCK_SIZE, count - block);
+			to_radians(radians, args, indices, first + block, block_count);
+			for (size_t j = 0; j < block_count; ++j)
+			{
+				instance_groups a;
+				load_groups(a, args, indices ? indices[first + block + j] : first + block + j, radians[j], default_size, default_uv);
+				_mm_storeu_ps(dst + 0, a.translate_scale);
+				_mm_storeu_ps(dst + 4, a.rotation_size);
+				_mm_storeu_ps(dst + 8, a.uv_rect);
+				_mm_storeu_ps(dst + 12, a.color);
+				_mm_storeu_ps(dst + 16, a.offset);
+				dst += imr::instancing_state::INSTANCE_FORMAT_COUNT;
+			}
+		}
+	}
+
+	// eight rotations per step, gathered when culling left an index list, and two instances per five 256 bit stores
+	IMR_TARGET_AVX2 void pack_instances_avx2(float* dst, const imr::instancing::instance_many_args& args, const uint32_t* indices, size_t first, size_t count, const imr::float2& texture_size, const imr::float4& texture_uv, float layer)
+	{
+		alignas(32) float radians[BLOCK_SIZE] = {};
+		const __m128 default_size = _mm_setr_ps(0, texture_size.x, texture_size.y, layer);
+		const __m128 default_uv = _mm_loadu_ps(texture_uv.value);
+		const __m256 deg_to_rad = _mm256_set1_ps(DEG_TO_RAD);
+		for (size_t block = 0; block < count; block += BLOCK_SIZE)
+		{
+			size_t block_count = std::min<size_t>(BLOCK_SIZE, count - block);
+			if (block_count == BLOCK_SIZE && args.rotations.empty() == false)
+			{
+				__m256 degrees = indices
+					? _mm256_i32gather_ps(args.rotations.data(), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + first + block)), sizeof(float))
+					: _mm256_loadu_ps(args.rotations.data() + first + block);
+				_mm256_store_ps(radians, _mm256_mul_ps(degrees, deg_to_rad));
+			}
+			else
+			{
+				to_radians(radians, args, indices, first + block, block_count);
+			}
+			auto item = [&](size_t j) { return indices ? indices[first + block + j] : first + block + j; };
+			size_t j = 0;
+			// two instances are 40 floats
+			for (; j + 1 < block_count; j += 2)
+			{
+				instance_groups a, b;
+				load_groups(a, args, item(j), radians[j], default_size, default_uv);
+				load_groups(b, args, item(j + 1), radians[j + 1], default_size, default_uv);
+				_mm256_storeu_ps(dst + 0, _mm256_set_m128(a.rotation_size, a.translate_scale));
+				_mm256_storeu_ps(dst + 8, _mm256_set_m128(a.color, a.uv_rect));
+				_mm256_storeu_ps(dst + 16, _mm256_set_m128(b.translate_scale, a.offset));
+				_mm256_storeu_ps(dst + 24, _mm256_set_m128(b.uv_rect, b.rotation_size));
+				_mm256_storeu_ps(dst + 32, _mm256_set_m128(b.offset, b.color));
+				dst += 2 * imr::instancing_state::INSTANCE_FORMAT_COUNT;
+			}
+			for (; j < block_count; ++j)
+			{
+				instance_groups a;
+				load_groups(a, args, item(j), radians[j], default_size, default_uv);
+				_mm_storeu_ps(dst + 0, a.translate_scale);
+				_mm_storeu_ps(dst + 4, a.rotation_size);
+				_mm_storeu_ps(dst + 8, a.uv_rect);
+				_mm_storeu_ps(dst + 12, a.color);
+				_mm_storeu_ps(dst + 16, a.offset);
+				dst += imr::instancing_state::INSTANCE_FORMAT_COUNT;
+			}
+		}
+	}
+}
+#endif
+
+namespace imr
+{
+	void pack_instances(float* dst, const imr::instancing::instance_many_args& args, const uint32_t* indices, size_t first, size_t count, const float2& texture_size, const float4& texture_uv, float layer)
+	{
+#if defined(IMR_SIMD_SSE2)
+		if (HAS_AVX2)
+		{
+			pack_instances_avx2(dst, args, indices, first, count, texture_size, texture_uv, layer);
+		}
+		else
+		{
+			pack_instances_sse2(dst, args, indices, first, count, texture_size, texture_uv, layer);
+		}
+#else
+		float radians[BLOCK_SIZE] = {};
+		for (size_t block = 0; block < count; block += BLOCK_SIZE)
+		{
+			size_t block_count = std::min<size_t>(BLOCK_SIZE, count - block);
+			to_radians(radians, args, indices, first + block, block_count);
+			for (size_t j = 0; j < block_count; ++j)
+			{
+				size_t i = indices ? indices[first + block + j] : first + block + j;
+				const float2& position = args.positions[i];
+				const float2& scale = args.scales.empty() ? DEFAULT_SCALE : args.scales[i];
+				const imr::float4& color = args.colors.empty() ? DEFAULT_COLOR : args.colors[i];
+				float2 size = texture_size;
+				const float4* uv_rect = &texture_uv;
+				const float2* offset = &DEFAULT_OFFSET;
+				float page = layer;
+				if (args.sprite_indices.empty() == false)
+				{
+					auto* sprite = args.sprites[args.sprite_indices[i]];
+					size = sprite->size;
+					uv_rect = &sprite->uv_rect;
+					offset = &sprite->offset;
+					page = sprite->layer;
+				}
+				int idx = 0;
+				// translate, scale
+				dst[idx++] = position.x;
+				dst[idx++] = position.y;
+				dst[idx++] = scale.x;
+				dst[idx++] = scale.y;
+				// rotation, width, height, layer
+				dst[idx++] = radians[j];
+				dst[idx++] = size.x;
+				dst[idx++] = size.y;
+				dst[idx++] = page;
+				// uv rect
+				dst[idx++] = uv_rect->x;
+				dst[idx++] = uv_rect->y;
+				dst[idx++] = uv_rect->z;
+				dst[idx++] = uv_rect->w;
+				// color
+				dst[idx++] = color.x;
+				dst[idx++] = color.y;
+				dst[idx++] = color.z;
+				dst[idx++] = color.w;
+				// offset, normal map sign, rev
+				dst[idx++] = offset->x;
+				dst[idx++] = offset->y;
+				dst[idx++] = scale.x < 0 ? -1.0f : 1.0f;
+				dst[idx++] = 0;
+				dst += instancing_state::INSTANCE_FORMAT_COUNT;
+			}
+		}
+#endif
+	}
+
+	size_t cull_instances(uint32_t* visible, const imr::instancing::instance_many_args& args, size_t count, const float2& texture_size, const float4& rect)
+	{
+		// sprites carry their radius at scale 1 since add_sprite_info
+		const float texture_radius = bounding_radius(texture_size, { 1, 1 }, {});
+
+		float radius[BLOCK_SIZE] = {};
+		size_t visible_count = 0;
+		for (size_t block = 0; block < count; block += BLOCK_SIZE)
+		{
+			size_t block_count = std::min<size_t>(BLOCK_SIZE, count - block);
+			for (size_t j = 0; j < block_count; ++j)
+			{
+				size_t i = block + j;
+				float r = args.sprite_indices.empty() ? texture_radius : args.sprites[args.sprite_indices[i]]->radius;
+				if (args.scales.empty() == false)
+				{
+					r *= std::max(std::abs(args.scales[i].x), std::abs(args.scales[i].y));
+				}
+				radius[j] = r;
+			}
+			size_t j = 0;
+#if defined(IMR_SIMD_SSE2)
+			const __m128 min_x = _mm_set1_ps(rect.x);
+			const __m128 min_y = _mm_set1_ps(rect.y);
+			const __m128 max_x = _mm_set1_ps(rect.z);
+			const __m128 max_y = _mm_set1_ps(rect.w);
+			for (; j + 4 <= block_count; j += 4)
+			{
+				// (x0 y0 x1 y1) (x2 y2 x3 y3) -> (x0 x1 x2 x3) (y0 y1 y2 y3)
+				const float* p = &args.positions[block + j].x;
+				__m128 a = _mm_loadu_ps(p);
+				__m128 b = _mm_loadu_ps(p + 4);
+				__m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+				__m128 r = _mm_loadu_ps(radius + j);
+				__m128 inside = _mm_and_ps(
+					_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(x, r), min_x), _mm_cmple_ps(_mm_sub_ps(x, r), max_x)),
+					_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(y, r), min_y), _mm_cmple_ps(_mm_sub_ps(y, r), max_y))
+				);
+				int mask = _mm_movemask_ps(inside);
+				for (int k = 0; k < 4; ++k)
+				{
+					if (mask & (1 << k))
+					{
+						visible[visible_count++] = static_cast<uint32_t>(block + j + k);
+					}
+				}
+			}
+#endif
+			for (; j < block_count; ++j)
+			{
+				if (outside_rect(rect, args.positions[block + j], radius[j]) == false)
+				{
+					visible[visible_count++] = static_cast<uint32_t>(block + j);
+				}
+			}
+		}
+		return visible_count;
+	}
+}
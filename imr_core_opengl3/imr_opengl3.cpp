@@ -1,33 +1,199 @@
 #include "imr_opengl3.h"
+#include <glm/gtc/packing.hpp>
 #include <stack>
 #include <optional>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "imr_tessellate.h"
 #include <unordered_map>
 #include <functional>
 #include <filesystem>
+#include <algorithm>
+#include <limits>
+#if defined(_M_X64) || defined(__SSE2__)
+#define IMR_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define IMR_NEON
+#include <arm_neon.h>
+#endif
 
 namespace
 {
-	const int texture_regs[4] = { imr::TEXTURE_REG_0, imr::TEXTURE_REG_1, imr::TEXTURE_REG_2, imr::TEXTURE_REG_3 };
+	const int texture_regs[6] = { imr::TEXTURE_REG_0, imr::TEXTURE_REG_1, imr::TEXTURE_REG_2, imr::TEXTURE_REG_3, imr::TEXTURE_REG_4, imr::TEXTURE_REG_5 };
+
+	// sources handed to glShaderSource, the preamble is part of the program cache key
+	std::array<const char*, 4> shader_codes(GLenum type, const char* code, bool camera_block)
+	{
+		// members are highp so both stages declare the block identically
+		const char* block = R"(
+			layout(std140) uniform uCamera
+			{
+				highp mat4 uProjectionMatrix;
+				highp mat4 uViewMatrix;
+				highp vec4 uResolutionTime;
+			};
+		)";
+		return {
+			"#version 300 es\n",
+			type == GL_FRAGMENT_SHADER ? "precision mediump float;" : "",
+			camera_block ? block : "",
+			code
+		};
+	}
+
+#ifdef _WIN32
+	typedef void (APIENTRYP get_program_binary_proc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+	typedef void (APIENTRYP program_binary_proc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+	typedef void (APIENTRYP program_parameteri_proc)(GLuint program, GLenum pname, GLint value);
+	get_program_binary_proc glGetProgramBinary = {};
+	program_binary_proc glProgramBinary = {};
+	program_parameteri_proc glProgramParameteri = {};
+
+	bool load_program_binary_procs()
+	{
+		if (glProgramBinary == nullptr && imr::gl_proc_loader && imr::extension_supported("GL_ARB_get_program_binary"))
+		{
+			glGetProgramBinary = reinterpret_cast<get_program_binary_proc>(imr::gl_proc_loader("glGetProgramBinary"));
+			glProgramBinary = reinterpret_cast<program_binary_proc>(imr::gl_proc_loader("glProgramBinary"));
+			glProgramParameteri = reinterpret_cast<program_parameteri_proc>(imr::gl_proc_loader("glProgramParameteri"));
+		}
+		return glGetProgramBinary && glProgramBinary && glProgramParameteri;
+	}
+#else
+	bool load_program_binary_procs()
+	{
+		return true;
+	}
+#endif
+
+	// GL_TIME_ELAPSED, GL_TIME_ELAPSED_EXT on gles
+	const GLenum TIME_ELAPSED = 0x88BF;
+#ifdef _WIN32
+	bool load_timer_query_procs()
+	{
+		return glGetQueryObjectui64v != nullptr;
+	}
+
+	GLuint64 query_elapsed_ns(GLuint query)
+	{
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+		return ns;
+	}
+
+	bool gpu_disjoint()
+	{
+		return false;
+	}
+#else
+	PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_object_ui64v = {};
+
+	bool load_timer_query_procs()
+	{
+		if (get_query_object_ui64v == nullptr && imr::gl_proc_loader && imr::extension_supported("GL_EXT_disjoint_timer_query"))
+		{
+			get_query_object_ui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(imr::gl_proc_loader("glGetQueryObjectui64vEXT"));
+		}
+		return get_query_object_ui64v != nullptr;
+	}
+
+	GLuint64 query_elapsed_ns(GLuint query)
+	{
+		GLuint64 ns = 0;
+		get_query_object_ui64v(query, GL_QUERY_RESULT, &ns);
+		return ns;
+	}
+
+	// reading the flag clears it
+	bool gpu_disjoint()
+	{
+		GLint disjoint = 0;
+		glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+		return disjoint != 0;
+	}
+#endif
+
+	double elapsed_ms(std::chrono::steady_clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+	}
+
+	imr::stats::counters counters_since(const imr::stats::counters& start)
+	{
+		auto& now = CTX->gl_state.counters;
+		return {
+			.draw_calls = now.draw_calls - start.draw_calls,
+			.instances = now.instances - start.instances,
+			.vertices = now.vertices - start.vertices,
+			.upload_bytes = now.upload_bytes - start.upload_bytes,
+			.program_switches = now.program_switches - start.program_switches,
+			.texture_binds = now.texture_binds - start.texture_binds,
+			.framebuffer_switches = now.framebuffer_switches - start.framebuffer_switches,
+			.stream_grows = now.stream_grows - start.stream_grows,
+		};
+	}
+
+	bool program_cache_enabled()
+	{
+		if (imr::program_cache_dir.empty() || !imr::load_data || !imr::save_data || load_program_binary_procs() == false)
+		{
+			return false;
+		}
+		GLint format_count = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+		return format_count > 0;
+	}
+
+	// fnv-1a over the driver strings and both stages
+	uint64_t program_cache_key(const char* vs, const char* fs, bool camera_block)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto feed = [&hash](const char* str)
+		{
+			for (; str && *str; ++str)
+			{
+				hash = (hash ^ static_cast<unsigned char>(*str)) * 1099511628211ull;
+			}
+			hash = (hash ^ 0xff) * 1099511628211ull;
+		};
+		feed(reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+		feed(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+		feed(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+		for (auto* code : shader_codes(GL_VERTEX_SHADER, vs, camera_block))
+		{
+			feed(code);
+		}
+		for (auto* code : shader_codes(GL_FRAGMENT_SHADER, fs, camera_block))
+		{
+			feed(code);
+		}
+		return hash;
+	}
+
+	std::string program_cache_path(uint64_t key)
+	{
+		char name[32] = {};
+		snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return imr::program_cache_dir + "/" + name;
+	}
 
-	void bind_multi_textures(const imr::program* program, const imr::Itexture_info* _1, const imr::Itexture_info* _2, const imr::Itexture_info* _3)
+	// the array programs sample the normal map as an array too, so an empty slot unbinds the array target
+	void bind_multi_textures(const imr::program* program, const imr::Itexture_info* _1, const imr::Itexture_info* _2, const imr::Itexture_info* _3, bool array = false)
 	{
 		const imr::Itexture_info* textures[3] = { _1, _2, _3 };
 
-		const int active_idx[3] = { GL_TEXTURE1, GL_TEXTURE2, GL_TEXTURE3 };
 		for (int i = 0; i < 3; ++i)
 		{
+			CTX->gl_state.active_texture(i + 1);
 			if (textures[i])
 			{
 				glUniform1i(program->get_uniform_location(texture_regs[i + 1]), i + 1);
-				glActiveTexture(active_idx[i]);
 				textures[i]->bind();
 			}
 			else
 			{
-				glActiveTexture(active_idx[i]);
-				glBindTexture(GL_TEXTURE_2D, 0);
+				CTX->gl_state.bind_texture(array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, 0);
 			}
 		}
 	}
@@ -37,18 +203,14 @@ namespace imr
 {
 	void frame_buffer_texture_info::unbind() const
 	{
-		glBindTexture(GL_TEXTURE_2D, 0);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, 0);
 	}
 
 	result atlas_info::add_sprite_info(const std::string& sprite_name, int2 position, int2 size, float2 offset)
 	{
 		assert(_texture_info);
-		float4 uv_rect = {};
-		uv_rect.xy = position / _texture_info->size();
-		uv_rect.zw = (position + size) / _texture_info->size();
-		uv_rect.y = 1.0f - uv_rect.y;
-		uv_rect.w = 1.0f - uv_rect.w;
-		_sprites[sprite_name] = { position, size, offset, uv_rect };
+		const float4 uv_rect = texture_uv_rect(_texture_info.get(), position, size);
+		_sprites[sprite_name] = { position, size, offset, uv_rect, bounding_radius(size, { 1, 1 }, offset), static_cast<float>(_texture_info->layer()) };
 		return {};
 	}
 
@@ -69,7 +231,12 @@ namespace imr
 {
 	void frame_backbuffer::bind()
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		CTX->gl_state.bind_framebuffer(0);
+	}
+
+	void invalidate_state_cache()
+	{
+		CTX->gl_state.invalidate();
 	}
 }
 
@@ -129,80 +296,165 @@ namespace imr
 
 	void program::use()
 	{
-		glUseProgram(_program);
+		CTX->gl_state.use_program(_program);
 	}
 
 	void program::unuse()
 	{
-		glUseProgram(0);
+		CTX->gl_state.use_program(0);
 	}
 
 	void program::destroy()
 	{
 		if (_program > 0)
 		{
+			CTX->gl_state.forget_program(_program);
 			glDeleteProgram(_program);
 			_program = 0;
 		}
 	}
 
-	std::tuple<result, std::shared_ptr<program>> program_builder::build(const char* vs, const char* fs)
+	std::tuple<result, std::shared_ptr<program>> program_builder::build(const char* vs, const char* fs, bool camera_block)
 	{
-		result ret;
-		auto [rst_v, vertex_shader] = load_shader(GL_VERTEX_SHADER, vs);
-		if (rst_v.type != imr::result_type::success)
+		auto pending = issue(vs, fs, camera_block);
+		return finish(pending);
+	}
+
+	pending_program program_builder::issue(const char* vs, const char* fs, bool camera_block)
+	{
+		pending_program ret = { .vs = vs, .fs = fs, .camera_block = camera_block };
+		if (program_cache_enabled() == false)
 		{
-			return { rst_v, { 0 } };
+			compile_and_link(ret);
+			return ret;
 		}
-		auto [rst_f, fragment_shader] = load_shader(GL_FRAGMENT_SHADER, fs);
-		if (rst_f.type != imr::result_type::success)
+
+		ret.cache_key = program_cache_key(vs, fs, camera_block);
+		auto data = load_data(program_cache_path(ret.cache_key));
+		if (data.size() > sizeof(GLenum))
 		{
-			return { rst_f, { 0 } };
+			GLenum format = 0;
+			memcpy(&format, data.data(), sizeof(format));
+			ret.program = glCreateProgram();
+			glProgramBinary(ret.program, format, data.data() + sizeof(format), static_cast<GLsizei>(data.size() - sizeof(format)));
+			ret.from_binary = true;
+			return ret;
 		}
+		compile_and_link(ret);
+		return ret;
+	}
 
-		GLuint prog = glCreateProgram();
-		glAttachShader(prog, vertex_shader);
-		glAttachShader(prog, fragment_shader);
-		glLinkProgram(prog);
+	void program_builder::release(pending_program& issued)
+	{
+		pending_program pending = std::exchange(issued, {});
+		if (pending.program == 0)
+		{
+			return;
+		}
+		if (pending.from_binary == false)
+		{
+			glDeleteShader(pending.vertex_shader);
+			glDeleteShader(pending.fragment_shader);
+		}
+		glDeleteProgram(pending.program);
+	}
 
-		glDeleteShader(vertex_shader);
-		glDeleteShader(fragment_shader);
+	std::tuple<result, std::shared_ptr<program>> program_builder::finish(pending_program& issued)
+	{
+		pending_program pending = std::exchange(issued, {});
+		GLint status = GL_FALSE;
+		if (pending.from_binary)
+		{
+			glGetProgramiv(pending.program, GL_LINK_STATUS, &status);
+			if (status == GL_FALSE)
+			{
+				// stale binary, e.g. after a driver update. an unknown format also raised GL_INVALID_ENUM
+				while (glGetError() != GL_NO_ERROR)
+				{
+				}
+				glDeleteProgram(pending.program);
+				pending.from_binary = false;
+				compile_and_link(pending);
+			}
+		}
 
-		GLint status;
-		glGetProgramiv(prog, GL_LINK_STATUS, &status);
-		if (status == GL_FALSE)
+		if (pending.from_binary == false)
 		{
-			ret.type = imr::result_type::fail;
-			ret.error_code = 1;
+			auto rst_v = shader_status(pending.vertex_shader);
+			auto rst_f = shader_status(pending.fragment_shader);
+			glDeleteShader(pending.vertex_shader);
+			glDeleteShader(pending.fragment_shader);
+			if (failed(rst_v) || failed(rst_f))
+			{
+				glDeleteProgram(pending.program);
+				return { failed(rst_v) ? rst_v : rst_f, { 0 } };
+			}
+
+			glGetProgramiv(pending.program, GL_LINK_STATUS, &status);
+			if (status == GL_FALSE)
+			{
+				result ret = { .type = imr::result_type::fail, .error_code = 1 };
+				GLint logLength = 0;
+				glGetProgramiv(pending.program, GL_INFO_LOG_LENGTH, &logLength);
+				GLchar* log = new GLchar[logLength + 1];
+				glGetProgramInfoLog(pending.program, logLength, &logLength, log);
+				ret.msg = log;
+				delete[] log;
+				glDeleteProgram(pending.program);
+				return { ret, { 0 } };
+			}
+
+			if (program_cache_enabled())
+			{
+				GLint length = 0;
+				glGetProgramiv(pending.program, GL_PROGRAM_BINARY_LENGTH, &length);
+				if (length > 0)
+				{
+					GLenum format = 0;
+					std::vector<char> data(sizeof(format) + length);
+					glGetProgramBinary(pending.program, length, &length, &format, data.data() + sizeof(format));
+					memcpy(data.data(), &format, sizeof(format));
+					data.resize(sizeof(format) + length);
+					save_data(program_cache_path(pending.cache_key), data);
+				}
+			}
+		}
 
-			GLint logLength = 0;
-			glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &logLength);
-			GLchar* log = new GLchar[logLength + 1];
-			glGetProgramInfoLog(prog, logLength, &logLength, log);
-			ret.msg = log;
-			delete[] log;
-			return { ret, { 0 } };
+		auto block_index = glGetUniformBlockIndex(pending.program, CAMERA_BLOCK_NAME);
+		if (block_index != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(pending.program, block_index, CAMERA_BLOCK_BINDING);
 		}
 
-		return { ret, std::make_shared<program>(prog) };
+		return { result{}, std::make_shared<program>(pending.program) };
 	}
 
-	std::tuple<result, GLuint> program_builder::load_shader(GLenum type, const char* code)
+	void program_builder::compile_and_link(pending_program& pending)
 	{
-		result ret = {};
-		GLuint shader = glCreateShader(type);
-		const char* precision = "";
-		if (type == GL_FRAGMENT_SHADER)
+		pending.vertex_shader = compile_shader(GL_VERTEX_SHADER, pending.vs, pending.camera_block);
+		pending.fragment_shader = compile_shader(GL_FRAGMENT_SHADER, pending.fs, pending.camera_block);
+		pending.program = glCreateProgram();
+		glAttachShader(pending.program, pending.vertex_shader);
+		glAttachShader(pending.program, pending.fragment_shader);
+		if (program_cache_enabled())
 		{
-			precision = "precision mediump float;";
-		};
-		const char* codes[] = {
-			"#version 300 es\n",
-			precision,
-			code
-		};
-		glShaderSource(shader, 3, codes, NULL);
+			glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glLinkProgram(pending.program);
+	}
+
+	GLuint program_builder::compile_shader(GLenum type, const char* code, bool camera_block)
+	{
+		GLuint shader = glCreateShader(type);
+		auto codes = shader_codes(type, code, camera_block);
+		glShaderSource(shader, static_cast<GLsizei>(codes.size()), codes.data(), NULL);
 		glCompileShader(shader);
+		return shader;
+	}
+
+	result program_builder::shader_status(GLuint shader)
+	{
+		result ret = {};
 		GLint status;
 		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 		if (status == GL_FALSE)
@@ -215,9 +467,8 @@ namespace imr
 			glGetShaderInfoLog(shader, infoLogLength, NULL, strInfoLog);
 			ret.msg = strInfoLog;
 			delete[] strInfoLog;
-			return { ret, 0 };
 		}
-		return { ret, shader };
+		return ret;
 	}
 
 	result context::create()
@@ -230,13 +481,11 @@ namespace imr
 			in vec4 aColor;
 			in vec4 aOffsetRev;
 
-			uniform mat4 uProjectionMatrix;
-			uniform mat4 uViewMatrix;
-
 			out vec2 vScreenPos;
 			out vec2 vTexCoord;
 			out vec4 vColor;
 			out float vScaleX;
+			out float vLayer;
 
 			void main()
 			{
@@ -281,7 +530,8 @@ namespace imr
 				vScreenPos = (gl_Position.xy + vec2(1.0, 1.0)) * 0.5;
 				vTexCoord = coord;
 				vColor = aColor;
-				vScaleX = aTranslateScale.z;
+				vScaleX = aOffsetRev.z;
+				vLayer = aRotationWidthHeightRev.w;
 			}
 		)";
 
@@ -312,32 +562,72 @@ namespace imr
 					OutColor[1] = nor;
                 }
 		)";
-		{
-			auto [res, instancing_program] = program_builder::build(
-				instancing_vs,
-				default_ps
-			);
-			if (res.type == result_type::fail)
+
+		// compact instance layout, see instancing_state::COMPACT_INSTANCE_FORMAT_COUNT
+		const char* instancing_compact_vs = R"(
+			in vec4 aPosition;
+			in vec2 aTranslate;
+			in vec4 aLinear;
+			in vec4 aUVRect;
+			in vec4 aColor;
+			in vec2 aScaleSignLayer;
+
+			out vec2 vScreenPos;
+			out vec2 vTexCoord;
+			out vec4 vColor;
+			out float vScaleX;
+			out float vLayer;
+
+			void main()
 			{
-				return res;
+				// rotation, size, scale and offset are baked on the cpu
+				vec2 pos = mat2(aLinear.xy, aLinear.zw) * aPosition.xy + aTranslate;
+
+				// pixel perfect
+				pos = floor(pos + 0.5);
+
+				// output
+				gl_Position = uProjectionMatrix * uViewMatrix * vec4(pos.xy, 0.1f, 1);
+				vScreenPos = (gl_Position.xy + vec2(1.0, 1.0)) * 0.5;
+				vTexCoord = mix(aUVRect.xy, aUVRect.zw, aPosition.xy);
+				vColor = aColor;
+				vScaleX = aScaleSignLayer.x;
+				vLayer = aScaleSignLayer.y;
 			}
-			instancing_program->bind_attrib_location(0, "aPosition");
-			instancing_program->bind_attrib_location(1, "aTranslateScale");
-			instancing_program->bind_attrib_location(2, "aRotationWidthHeightRev");
-			instancing_program->bind_attrib_location(3, "aUVRect");
-			instancing_program->bind_attrib_location(4, "aColor");
-			instancing_program->bind_attrib_location(5, "aOffsetRev");
-			instancing_program->bind_uniform_location(0, "uProjectionMatrix");
-			instancing_program->bind_uniform_location(1, "uViewMatrix");
-			instancing_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
-			instancing_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
-			regist_program(INSTANCING_PROGRAM_NAME, instancing_program);
-		}
+		)";
 
-		{
-			auto [res, text_program] = program_builder::build(
-				instancing_vs,
-				R"(
+		// default_ps sampling texture array pages, the layer comes with every instance
+		const char* array_ps = R"(
+				precision mediump sampler2DArray;
+
+				uniform sampler2DArray uSampler;
+				uniform sampler2DArray uNormalSampler;
+
+				in vec2 vTexCoord;
+				in vec4 vColor;
+				in float vScaleX;
+				in float vLayer;
+
+				out vec4 OutColor[4];
+
+				void main()
+				{
+					vec3 coord = vec3(vTexCoord, vLayer);
+					vec4 col = texture(uSampler, coord) * vColor;
+					vec4 nor = texture(uNormalSampler, coord);
+					if (vScaleX < 0.0)
+					{
+						float nx = -1.0 * (nor.x * 2.0 - 1.0);
+						nx = (nx + 1.0) / 2.0;
+						nor.x = nx;
+					}
+					nor.a = col.a;
+					OutColor[0] = col;
+					OutColor[1] = nor;
+				}
+		)";
+
+		const char* text_ps = R"(
 					uniform sampler2D uSampler;
 
 					in vec2 vTexCoord;
@@ -353,28 +643,9 @@ namespace imr
 						OutColor[0] = col * vColor;
 						OutColor[1] = vec4(0.0, 0.0, 1.0, 1.0);
 					}	
-			)");
-			if (res.type == result_type::fail)
-			{
-				return res;
-			}
-			text_program->bind_attrib_location(0, "aPosition");
-			text_program->bind_attrib_location(1, "aTranslateScale");
-			text_program->bind_attrib_location(2, "aRotationWidthHeightRev");
-			text_program->bind_attrib_location(3, "aUVRect");
-			text_program->bind_attrib_location(4, "aColor");
-			text_program->bind_attrib_location(5, "aOffsetRev");
-			text_program->bind_uniform_location(0, "uProjectionMatrix");
-			text_program->bind_uniform_location(1, "uViewMatrix");
-			text_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
-			regist_program(TEXT_PROGRAM_NAME, text_program);
-		}
+			)";
 
-		{
-			auto [res, light_program] = program_builder::build(
-				instancing_vs
-				,
-				R"(
+		const char* light_ps = R"(
 					uniform sampler2D uLightSampler;
 					uniform sampler2D uLightDirSampler;
 					uniform sampler2D uNormalSampler;
@@ -397,31 +668,70 @@ namespace imr
 						col.a = lightCol.r * normalCol.a;
 						OutColor[0] = col;
 					}		
-			)");
-			if (res.type == result_type::fail)
+			)";
+
+		// instancing layout with the shape in aUVRect: corner radius, stroke width (0 fills)
+		const char* primitive_vs = R"(
+			in vec4 aPosition;
+			in vec4 aTranslateScale;
+			in vec4 aRotationWidthHeightRev;
+			in vec4 aUVRect;
+			in vec4 aColor;
+			in vec4 aOffsetRev;
+
+			out vec2 vLocal;
+			out vec4 vShape;
+			out vec4 vColor;
+
+			void main()
 			{
-				return res;
+				// the quad grows by a pixel on every side for the antialiased edge
+				vec2 pixels_per_unit = (uProjectionMatrix * uViewMatrix * vec4(1, 0, 0, 0)).xy * uResolutionTime.xy * 0.5;
+				float margin = 1.0 / max(length(pixels_per_unit), 0.0001);
+				vec2 size = aRotationWidthHeightRev.yz * abs(aTranslateScale.zw);
+				vec2 local = (aPosition.xy - vec2(0.5, 0.5)) * (size + 2.0 * margin);
+
+				// rotation around the pivot
+				vec2 pos = local + (vec2(0.5, 0.5) - aOffsetRev.xy) * size;
+				float rotation = aRotationWidthHeightRev.x;
+				pos = vec2(pos.x * cos(rotation) - pos.y * sin(rotation), pos.x * sin(rotation) + pos.y * cos(rotation));
+				pos += aTranslateScale.xy;
+
+				gl_Position = uProjectionMatrix * uViewMatrix * vec4(pos, 0.1f, 1);
+				vLocal = local;
+				// half extents of the shape without its stroke
+				vShape = vec4(size * 0.5 - aUVRect.y * 0.5, aUVRect.x, aUVRect.y);
+				vColor = aColor;
 			}
-			light_program->bind_attrib_location(0, "aPosition");
-			light_program->bind_attrib_location(1, "aTranslateScale");
-			light_program->bind_attrib_location(2, "aRotationWidthHeightRev");
-			light_program->bind_attrib_location(3, "aUVRect");
-			light_program->bind_attrib_location(4, "aColor");
-			light_program->bind_attrib_location(5, "aOffsetRev");
-			light_program->bind_uniform_location(0, "uProjectionMatrix");
-			light_program->bind_uniform_location(1, "uViewMatrix");
-			light_program->bind_uniform_location(TEXTURE_REG_0, "uLightSampler");
-			light_program->bind_uniform_location(TEXTURE_REG_1, "uLightDirSampler");
-			light_program->bind_uniform_location(TEXTURE_REG_2, "uNormalSampler");
-			regist_program(LIGHT_PROGRAM_NAME, light_program);
-		}
+		)";
 
-		{
-			auto [res, sprite_program] = program_builder::build(
-				R"(
+		const char* primitive_ps = R"(
+				in highp vec2 vLocal;
+				in highp vec4 vShape;
+				in vec4 vColor;
+
+				out vec4 OutColor[2];
+
+				void main()
+				{
+					// rounded box distance, circles and capsules are boxes rounded by their half height
+					highp vec2 q = abs(vLocal) - vShape.xy + vShape.z;
+					highp float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - vShape.z;
+					if (vShape.w > 0.0)
+					{
+						d = abs(d) - vShape.w * 0.5;
+					}
+					float coverage = clamp(0.5 - d / max(fwidth(d), 0.0001), 0.0, 1.0);
+					vec4 col = vec4(vColor.rgb, vColor.a * coverage);
+					OutColor[0] = col;
+					OutColor[1] = vec4(0.5, 0.5, 1.0, col.a);
+				}
+			)";
+
+		const char* sprite_vs = R"(
 				in vec4 aPosition;
 
-				uniform vec4 ub[13];
+				uniform vec4 ub[5];
 
 				out vec2 vTexCoord;
 				out vec4 vColor;
@@ -429,13 +739,11 @@ namespace imr
 
 				void main()
 				{
-					mat4 uProjectionMatrix = mat4(ub[0], ub[1], ub[2], ub[3]);
-					mat4 uViewMatrix = mat4(ub[4], ub[5], ub[6], ub[7]);
-					vec4 uTranslateScale = ub[8]; 
-					vec4 uSizeOffset = ub[9]; 
-					vec4 uColor = ub[10]; 
-					vec4 uUVRect = ub[11]; 
-					float uRotation = ub[12].x; 
+					vec4 uTranslateScale = ub[0];
+					vec4 uSizeOffset = ub[1];
+					vec4 uColor = ub[2];
+					vec4 uUVRect = ub[3];
+					float uRotation = ub[4].x;
 
 					vec4 pos = vec4(aPosition.xy, 0, 1) - vec4(uSizeOffset.zw, 0, 0);
 
@@ -478,56 +786,26 @@ namespace imr
 					vColor = uColor;
 					vScaleX = 1.0f;
 				}
-			)",
-				default_ps
-			);
-			if (res.type == result_type::fail)
-			{
-				return res;
-			}
-			sprite_program->bind_attrib_location(0, "aPosition");
-			sprite_program->bind_uniform_location(0, "ub[0]");
-			sprite_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
-			sprite_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
-			regist_program(SPRITE_PROGRAM_NAME, sprite_program);
-		}
+			)";
 
-		{
-			auto [res, mesh_program] = program_builder::build(
-				R"(
+		const char* mesh_vs = R"(
 					in vec4 aPosUV;
 					in vec4 aColor;
 
-					uniform mat4 ub[2];
-
 					out vec2 vTexCoord;
 					out vec4 vColor;
 					out float vScaleX;
 
 					void main()
 					{
-						mat4 uProjectionMatrix = ub[0];
-						mat4 uViewMatrix = ub[1];
 						gl_Position = uProjectionMatrix * uViewMatrix * vec4(aPosUV.xy, 0.1f, 1);
 						vTexCoord = aPosUV.zw;
 						vColor = aColor;
 						vScaleX = 1.0f;
 					}
-			)",
-				default_ps
-			);
-			IMRRESULT(res);
-			mesh_program->bind_attrib_location(0, "aPosUV");
-			mesh_program->bind_attrib_location(1, "aColor");
-			mesh_program->bind_uniform_location(0, "ub[0]");
-			mesh_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
-			mesh_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
-			regist_program(MESH_PROGRAM_NAME, mesh_program);
-		}
+			)";
 
-		{
-			auto [res, fog_program] = program_builder::build(
-				R"(
+		const char* fog_vs = R"(
 					in vec4 aPosUV;
 
 					out vec2 vTexCoord;
@@ -537,8 +815,9 @@ namespace imr
 						gl_Position = vec4(aPosUV.xy, 0.0, 1.0);
 						vTexCoord = aPosUV.zw;
 					}
-				)",
-				R"(
+				)";
+
+		const char* fog_ps = R"(
 				precision highp float;
 				const vec3 COLOR = vec3(0.25, 0.25, 0.25);
 				const vec3 BG = vec3(0.0, 0.0, 0.0);
@@ -580,7 +859,7 @@ namespace imr
 					return value + 0.2;
 				}
 
-				uniform mat4 ub[2];
+				// register 1, callers that still set it override the camera block
 				uniform vec4 uResolutionTimeRev;
 
                 in vec2 vTexCoord;
@@ -588,48 +867,35 @@ namespace imr
 
                 void main()
                 {
-					mat4 uProjectionMatrix = ub[0];
-					mat4 uViewMatrix = ub[1];
-					float iTime = uResolutionTimeRev.z;
+					vec4 resolution_time = uResolutionTimeRev.y > 0.0 ? uResolutionTimeRev : uResolutionTime;
+					float iTime = resolution_time.z;
 					vec4 offset = uProjectionMatrix * uViewMatrix * vec4(0.0, 0.0, 0.0, 1);
 					offset.x *= -1.0;
 					vec2 st = vTexCoord + offset.xy * 0.125;
-					st *= uResolutionTimeRev.xy  / uResolutionTimeRev.y;    
+					st *= resolution_time.xy  / resolution_time.y;    
 					vec2 pos = vec2(st * ZOOM);
 					vec2 motion = vec2(fractal_brownian_motion(pos + vec2(iTime * -0.5, iTime * -0.3)));
 					float final = fractal_brownian_motion(pos + motion) * INTENSITY;
 					OutColor = vec4(mix(BG, COLOR, final), 1.0);
                 }
-			)"
-			);
-			IMRRESULT(res);
-			fog_program->bind_attrib_location(0, "aPosUV");
-			fog_program->bind_uniform_location(0, "ub[0]");
-			fog_program->bind_uniform_location(1, "uResolutionTimeRev");
-			regist_program(FOG_PROGRAM_NAME, fog_program);
-		}
+			)";
 
-		{
-			auto [res, deffered_program] = program_builder::build(
-				R"(
+		const char* deffered_vs = R"(
 					in vec4 aPosUV;
 					in vec4 aColor;
 
-					uniform mat4 ub[2];
-
 					out vec2 vTexCoord;
 					out vec4 vColor;
 
 					void main()
 					{
-						mat4 uProjectionMatrix = ub[0];
-						mat4 uViewMatrix = ub[1];
 						gl_Position = uProjectionMatrix * uViewMatrix * vec4(aPosUV.xy, 0.1f, 1);
 						vTexCoord = aPosUV.zw;
 						vColor = aColor;
 					}
-			)",
-				R"(
+			)";
+
+		const char* deffered_ps = R"(
 				//precision highp float;
 
                 uniform sampler2D uAlbedoSampler;
@@ -651,18 +917,203 @@ namespace imr
 					
 					OutColor = mix(fog_col, vec4(col, 1.0), lit_col.a) * vColor;
                 }
-			)"
-			);
+			)";
+
+		// every program is compiled and linked before any status is read, so the driver can work on them in parallel
+		auto instancing_pending = program_builder::issue(instancing_vs, default_ps, true);
+		auto instancing_compact_pending = program_builder::issue(instancing_compact_vs, default_ps, true);
+		auto instancing_array_pending = program_builder::issue(instancing_vs, array_ps, true);
+		auto instancing_compact_array_pending = program_builder::issue(instancing_compact_vs, array_ps, true);
+		auto text_pending = program_builder::issue(instancing_vs, text_ps, true);
+		auto light_pending = program_builder::issue(instancing_vs, light_ps, true);
+		auto primitive_pending = program_builder::issue(primitive_vs, primitive_ps, true);
+		auto sprite_pending = program_builder::issue(sprite_vs, default_ps, true);
+		auto mesh_pending = program_builder::issue(mesh_vs, default_ps, true);
+		auto fog_pending = program_builder::issue(fog_vs, fog_ps, true);
+		auto deffered_pending = program_builder::issue(deffered_vs, deffered_ps, true);
+		// a failed finish returns early, whatever is still pending is released on the way out
+		struct pending_guard
+		{
+			std::vector<pending_program*> pendings;
+			~pending_guard()
+			{
+				for (auto* pending : pendings)
+				{
+					program_builder::release(*pending);
+				}
+			}
+		} guard = { {
+			&instancing_pending, &instancing_compact_pending, &instancing_array_pending, &instancing_compact_array_pending,
+			&text_pending, &light_pending, &primitive_pending, &sprite_pending, &mesh_pending, &fog_pending, &deffered_pending
+		} };
+
+		{
+			auto [res, instancing_program] = program_builder::finish(instancing_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			instancing_program->bind_attrib_location(0, "aPosition");
+			instancing_program->bind_attrib_location(1, "aTranslateScale");
+			instancing_program->bind_attrib_location(2, "aRotationWidthHeightRev");
+			instancing_program->bind_attrib_location(3, "aUVRect");
+			instancing_program->bind_attrib_location(4, "aColor");
+			instancing_program->bind_attrib_location(5, "aOffsetRev");
+			instancing_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			instancing_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
+			regist_program(INSTANCING_PROGRAM_NAME, instancing_program);
+		}
+
+		{
+			auto [res, instancing_compact_program] = program_builder::finish(instancing_compact_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			instancing_compact_program->bind_attrib_location(0, "aPosition");
+			instancing_compact_program->bind_attrib_location(1, "aTranslate");
+			instancing_compact_program->bind_attrib_location(2, "aLinear");
+			instancing_compact_program->bind_attrib_location(3, "aUVRect");
+			instancing_compact_program->bind_attrib_location(4, "aColor");
+			instancing_compact_program->bind_attrib_location(5, "aScaleSignLayer");
+			instancing_compact_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			instancing_compact_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
+			regist_program(INSTANCING_COMPACT_PROGRAM_NAME, instancing_compact_program);
+		}
+
+		{
+			auto [res, instancing_array_program] = program_builder::finish(instancing_array_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			instancing_array_program->bind_attrib_location(0, "aPosition");
+			instancing_array_program->bind_attrib_location(1, "aTranslateScale");
+			instancing_array_program->bind_attrib_location(2, "aRotationWidthHeightRev");
+			instancing_array_program->bind_attrib_location(3, "aUVRect");
+			instancing_array_program->bind_attrib_location(4, "aColor");
+			instancing_array_program->bind_attrib_location(5, "aOffsetRev");
+			instancing_array_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			instancing_array_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
+			regist_program(INSTANCING_ARRAY_PROGRAM_NAME, instancing_array_program);
+		}
+
+		{
+			auto [res, instancing_compact_array_program] = program_builder::finish(instancing_compact_array_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			instancing_compact_array_program->bind_attrib_location(0, "aPosition");
+			instancing_compact_array_program->bind_attrib_location(1, "aTranslate");
+			instancing_compact_array_program->bind_attrib_location(2, "aLinear");
+			instancing_compact_array_program->bind_attrib_location(3, "aUVRect");
+			instancing_compact_array_program->bind_attrib_location(4, "aColor");
+			instancing_compact_array_program->bind_attrib_location(5, "aScaleSignLayer");
+			instancing_compact_array_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			instancing_compact_array_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
+			regist_program(INSTANCING_COMPACT_ARRAY_PROGRAM_NAME, instancing_compact_array_program);
+		}
+
+		{
+			auto [res, text_program] = program_builder::finish(text_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			text_program->bind_attrib_location(0, "aPosition");
+			text_program->bind_attrib_location(1, "aTranslateScale");
+			text_program->bind_attrib_location(2, "aRotationWidthHeightRev");
+			text_program->bind_attrib_location(3, "aUVRect");
+			text_program->bind_attrib_location(4, "aColor");
+			text_program->bind_attrib_location(5, "aOffsetRev");
+			text_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			regist_program(TEXT_PROGRAM_NAME, text_program);
+		}
+
+		{
+			auto [res, light_program] = program_builder::finish(light_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			light_program->bind_attrib_location(0, "aPosition");
+			light_program->bind_attrib_location(1, "aTranslateScale");
+			light_program->bind_attrib_location(2, "aRotationWidthHeightRev");
+			light_program->bind_attrib_location(3, "aUVRect");
+			light_program->bind_attrib_location(4, "aColor");
+			light_program->bind_attrib_location(5, "aOffsetRev");
+			light_program->bind_uniform_location(TEXTURE_REG_0, "uLightSampler");
+			light_program->bind_uniform_location(TEXTURE_REG_1, "uLightDirSampler");
+			light_program->bind_uniform_location(TEXTURE_REG_2, "uNormalSampler");
+			regist_program(LIGHT_PROGRAM_NAME, light_program);
+		}
+
+		{
+			auto [res, primitive_program] = program_builder::finish(primitive_pending);
+			IMRRESULT(res);
+			primitive_program->bind_attrib_location(0, "aPosition");
+			primitive_program->bind_attrib_location(1, "aTranslateScale");
+			primitive_program->bind_attrib_location(2, "aRotationWidthHeightRev");
+			primitive_program->bind_attrib_location(3, "aUVRect");
+			primitive_program->bind_attrib_location(4, "aColor");
+			primitive_program->bind_attrib_location(5, "aOffsetRev");
+			regist_program(PRIMITIVE_PROGRAM_NAME, primitive_program);
+		}
+
+		{
+			auto [res, sprite_program] = program_builder::finish(sprite_pending);
+			if (res.type == result_type::fail)
+			{
+				return res;
+			}
+			sprite_program->bind_attrib_location(0, "aPosition");
+			sprite_program->bind_uniform_location(0, "ub[0]");
+			sprite_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			sprite_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
+			regist_program(SPRITE_PROGRAM_NAME, sprite_program);
+		}
+
+		{
+			auto [res, mesh_program] = program_builder::finish(mesh_pending);
+			IMRRESULT(res);
+			mesh_program->bind_attrib_location(0, "aPosUV");
+			mesh_program->bind_attrib_location(1, "aColor");
+			mesh_program->bind_uniform_location(TEXTURE_REG_0, "uSampler");
+			mesh_program->bind_uniform_location(TEXTURE_REG_1, "uNormalSampler");
+			regist_program(MESH_PROGRAM_NAME, mesh_program);
+		}
+
+		{
+			auto [res, fog_program] = program_builder::finish(fog_pending);
+			IMRRESULT(res);
+			fog_program->bind_attrib_location(0, "aPosUV");
+			fog_program->bind_uniform_location(1, "uResolutionTimeRev");
+			regist_program(FOG_PROGRAM_NAME, fog_program);
+		}
+
+		{
+			auto [res, deffered_program] = program_builder::finish(deffered_pending);
 			IMRRESULT(res);
 			deffered_program->bind_attrib_location(0, "aPosUV");
 			deffered_program->bind_attrib_location(1, "aColor");
-			deffered_program->bind_uniform_location(0, "ub[0]");
 			deffered_program->bind_uniform_location(TEXTURE_REG_0, "uAlbedoSampler");
 			deffered_program->bind_uniform_location(TEXTURE_REG_1, "uLightColorSampler");
 			deffered_program->bind_uniform_location(TEXTURE_REG_2, "uFogSampler");
 			regist_program(DEFFERED_PROGRAM_NAME, deffered_program);
 		}
 
+		{
+			builtin_programs.instancing = get_program_handle(INSTANCING_PROGRAM_NAME);
+			builtin_programs.instancing_compact = get_program_handle(INSTANCING_COMPACT_PROGRAM_NAME);
+			builtin_programs.instancing_array = get_program_handle(INSTANCING_ARRAY_PROGRAM_NAME);
+			builtin_programs.instancing_compact_array = get_program_handle(INSTANCING_COMPACT_ARRAY_PROGRAM_NAME);
+			builtin_programs.text = get_program_handle(TEXT_PROGRAM_NAME);
+			builtin_programs.primitive = get_program_handle(PRIMITIVE_PROGRAM_NAME);
+			builtin_programs.sprite = get_program_handle(SPRITE_PROGRAM_NAME);
+			builtin_programs.mesh = get_program_handle(MESH_PROGRAM_NAME);
+		}
+
 		{
 			float vertices[] = {
 				0, 0, 0,
@@ -673,44 +1124,55 @@ namespace imr
 			unsigned short indices[] = {
 				0, 1, 2, 2, 3, 0
 			};
-			auto quad_vbo = create_array_buffer(vertices, sizeof(vertices), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-			auto indices_vbo = create_array_buffer(indices, sizeof(indices), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+			quad_vertices = create_array_buffer(vertices, sizeof(vertices), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+			quad_indices = create_array_buffer(indices, sizeof(indices), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
 			glGenVertexArrays(1, &quad_vao);
-			glBindVertexArray(quad_vao);
+			gl_state.bind_vertex_array(quad_vao);
 			{
-				quad_vbo->bind();
+				quad_vertices->bind();
 				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 				glEnableVertexAttribArray(0);
-				indices_vbo->bind();
-			}
-			glBindVertexArray(0);
-
-			glGenVertexArrays(1, &instancing_attrib_vao);
-			glBindVertexArray(instancing_attrib_vao);
-			{
-				quad_vbo->bind();
-				glEnableVertexAttribArray(0);
-				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-				indices_vbo->bind();
+				quad_indices->bind();
 			}
-			glBindVertexArray(0);
+			gl_state.bind_vertex_array(0);
 
 			glGenVertexArrays(1, &temp_vao);
+			temp_vao_attribs = 0;
+		}
+
+		{
+			glGenBuffers(1, &camera_ubo);
+			glBindBuffer(GL_UNIFORM_BUFFER, camera_ubo);
+			glBufferData(GL_UNIFORM_BUFFER, sizeof(camera_block), nullptr, GL_DYNAMIC_DRAW);
+			glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, camera_ubo);
+			start_time = std::chrono::steady_clock::now();
+		}
+
+		{
+			vertex_stream = std::make_unique<stream_buffer>(VERTEX_STREAM_CAPACITY, GL_ARRAY_BUFFER);
+			index_stream = std::make_unique<stream_buffer>(INDEX_STREAM_CAPACITY, GL_ELEMENT_ARRAY_BUFFER);
+			vertex_stream->unbind();
+			index_stream->unbind();
 		}
 
 		{
 			auto white_texture_info = std::make_shared<texture_info>();
 			this->white_texture_info = white_texture_info;
 			glGenTextures(1, &white_texture_info->resource);
-			glBindTexture(GL_TEXTURE_2D, white_texture_info->resource);
+			gl_state.bind_texture(GL_TEXTURE_2D, white_texture_info->resource);
 			unsigned int data[1] = { 0xFFFFFFFF };
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			gl_state.bind_texture(GL_TEXTURE_2D, 0);
 			white_texture_info->_width = 1;
 			white_texture_info->_height = 1;
 			white_texture_info->texture_name = "__white_texture__";
 		}
 
+		{
+			timer_query_supported = load_timer_query_procs();
+			frame_start_time = std::chrono::steady_clock::now();
+		}
+
 		return {};
 	}
 
@@ -719,40 +1181,151 @@ namespace imr
 		{
 			for (auto& p : programs)
 			{
-				if (p.second)
+				if (p)
 				{
-					p.second->destroy();
+					p->destroy();
 				}
 			}
 			programs.clear();
+			gl_programs.clear();
+			program_generations.clear();
+			program_handles.clear();
+			builtin_programs = {};
 		}
 
 		{
+			gl_state.bind_vertex_array(0);
 			glDeleteVertexArrays(1, &quad_vao);
-			glDeleteVertexArrays(1, &instancing_attrib_vao);
 			glDeleteVertexArrays(1, &temp_vao);
+			for (auto& [prg, vao] : instancing_vaos)
+			{
+				glDeleteVertexArrays(1, &vao);
+			}
 			quad_vao = 0;
-			instancing_attrib_vao = 0;
 			temp_vao = 0;
+			temp_vao_attribs = 0;
+			instancing_vaos.clear();
+		}
+
+		{
+			glDeleteBuffers(1, &camera_ubo);
+			camera_ubo = 0;
+			quad_vertices.reset();
+			quad_indices.reset();
+			vertex_stream.reset();
+			index_stream.reset();
+			mesh_levels.clear();
+			workers.reset();
+		}
+
+		{
+			// joins the decoders, whatever they finished is dropped without an upload
+			loaders.reset();
+			for (auto& decoded : decoded_textures)
+			{
+				stbi_image_free(decoded.pixels);
+			}
+			decoded_textures.clear();
+		}
+
+		{
+			layer_caches.clear();
+			layer_cache_current = {};
+			layer_cache_recording = false;
+			// targets still held outside outlive the pool and free themselves
+			render_targets.clear();
+		}
+
+		{
+			shape_cache_index.clear();
+			shape_cache.clear();
+			shape_scratch = {};
+		}
+
+		{
+			for (auto& pending : pending_stats)
+			{
+				for (auto query : pending.pass_queries)
+				{
+					if (query)
+					{
+						free_timer_queries.push_back(query);
+					}
+				}
+			}
+			if (free_timer_queries.empty() == false)
+			{
+				glDeleteQueries(static_cast<GLsizei>(free_timer_queries.size()), free_timer_queries.data());
+			}
+			free_timer_queries.clear();
+			pending_stats.clear();
+			recording_stats = {};
+			stats_history.clear();
+			timer_query_active = false;
 		}
+	}
 
+	GLuint context::get_instancing_vao(program* prg)
+	{
+		auto& vao = instancing_vaos[prg];
+		if (vao == 0)
 		{
-			array_buffer_pool.clear();
+			// draws only repoint the instance attributes into the stream
+			glGenVertexArrays(1, &vao);
+			gl_state.bind_vertex_array(vao);
+			quad_vertices->bind();
+			auto position = prg->get_attrib_location(0);
+			glEnableVertexAttribArray(position);
+			glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+			quad_indices->bind();
+			for (int reg = 1; reg <= 5; ++reg)
+			{
+				auto loc = prg->get_attrib_location(reg);
+				glEnableVertexAttribArray(loc);
+				glVertexAttribDivisor(loc, 1);
+			}
 		}
+		return vao;
+	}
+
+	gl_state_cache& current_gl_state()
+	{
+		return CTX->gl_state;
+	}
+
+	const state_cache_stats& get_state_cache_stats()
+	{
+		return CTX->gl_state.stats;
+	}
+
+	void reset_state_cache_stats()
+	{
+		CTX->gl_state.stats = {};
 	}
 
 	void texture_info::bind() const
 	{
-		glBindTexture(GL_TEXTURE_2D, resource);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, resource);
 	}
 
 	void texture_info::unbind() const
 	{
-		glBindTexture(GL_TEXTURE_2D, 0);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, 0);
+	}
+
+	void texture_array_info::bind() const
+	{
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D_ARRAY, resource);
+	}
+
+	void texture_array_info::unbind() const
+	{
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D_ARRAY, 0);
 	}
 
 	void texture_info::destroy()
 	{
+		CTX->gl_state.forget_texture(resource);
 		glDeleteTextures(1, &resource);
 		resource = 0;
 		_width = 0;
@@ -761,28 +1334,72 @@ namespace imr
 
 	result regist_program(const std::string& name, std::shared_ptr<Iprogram> program)
 	{
-		if (CTX->programs.find(name) != CTX->programs.end())
+		auto [ret, handle] = regist_program_handle(name, program);
+		return ret;
+	}
+
+	std::tuple<result, program_handle> regist_program_handle(const std::string& name, std::shared_ptr<Iprogram> program)
+	{
+		if (CTX->program_handles.find(name) != CTX->program_handles.end())
 		{
-			return { .type = result_type::fail, .error_code = 1, .msg = "already exist" };
+			return { { .type = result_type::fail, .error_code = 1, .msg = "already exist" }, INVALID_PROGRAM_HANDLE };
 		}
-		CTX->programs[name] = program;
-		return {};
+		auto& programs = CTX->programs;
+		auto slot = std::find(programs.begin(), programs.end(), nullptr);
+		program_handle handle = { .slot = static_cast<int>(slot - programs.begin()) };
+		if (slot == programs.end())
+		{
+			programs.push_back({});
+			CTX->gl_programs.push_back({});
+			CTX->program_generations.push_back(0);
+		}
+		handle.generation = CTX->program_generations[handle.slot];
+		programs[handle.slot] = program;
+		CTX->gl_programs[handle.slot] = dynamic_cast<imr::program*>(program.get());
+		CTX->program_handles[name] = handle;
+		return { result{}, handle };
 	}
 
 	result unregist_program(const std::string& name)
 	{
-		if (CTX->programs.find(name) == CTX->programs.end())
+		auto it = CTX->program_handles.find(name);
+		if (it == CTX->program_handles.end())
 		{
 			return { .type = result_type::fail, .error_code = 1, .msg = "not registered program" };
 		}
-		CTX->programs[name]->destroy();
-		CTX->programs.erase(name);
+		const int slot = it->second.slot;
+		if (auto* prg = CTX->gl_programs[slot])
+		{
+			if (auto vao = CTX->instancing_vaos.find(prg); vao != CTX->instancing_vaos.end())
+			{
+				CTX->gl_state.forget_vertex_array(vao->second);
+				glDeleteVertexArrays(1, &vao->second);
+				CTX->instancing_vaos.erase(vao);
+			}
+		}
+		CTX->programs[slot]->destroy();
+		CTX->programs[slot] = nullptr;
+		CTX->gl_programs[slot] = nullptr;
+		// handles still pointing at the slot stop resolving
+		CTX->program_generations[slot]++;
+		CTX->program_handles.erase(it);
 		return {};
 	}
 
+	program_handle get_program_handle(const std::string& name)
+	{
+		auto it = CTX->program_handles.find(name);
+		return it == CTX->program_handles.end() ? INVALID_PROGRAM_HANDLE : it->second;
+	}
+
 	void push_program(const char* program_name)
 	{
-		CTX->program_stack.push(program_name);
+		push_program(get_program_handle(program_name));
+	}
+
+	void push_program(program_handle handle)
+	{
+		CTX->program_stack.push(handle);
 	}
 
 	void pop_program()
@@ -832,7 +1449,7 @@ namespace imr
 			},
 			[](const viewport_state& state)
 			{
-				glViewport(state.x, state.y, state.width, state.height);
+				CTX->gl_state.viewport(state.x, state.y, state.width, state.height);
 			});
 	}
 
@@ -845,20 +1462,32 @@ namespace imr
 			},
 			[](const viewport_state& state)
 			{
-				glViewport(state.x, state.y, state.width, state.height);
+				CTX->gl_state.viewport(state.x, state.y, state.width, state.height);
 			});
 	}
 
+	void apply_blend_func(const blend_func_state& state)
+	{
+		if (state.separate_alpha)
+		{
+			CTX->gl_state.blend_func(state.src, state.dst, state.src_alpha, state.dst_alpha);
+		}
+		else
+		{
+			CTX->gl_state.blend_func(state.src, state.dst);
+		}
+	}
+
 	void push_blend_func(const blend_func_state& state)
 	{
 		push_state<blend_func_state>(CTX->blend_func_stack, state,
 			[](const blend_func_state& old, const blend_func_state& cur)
 			{
-				return old.src == cur.src && old.dst == cur.dst;
+				return old == cur;
 			},
 			[](const blend_func_state& state)
 			{
-				glBlendFunc(state.src, state.dst);
+				apply_blend_func(state);
 			});
 	}
 
@@ -867,86 +1496,1007 @@ namespace imr
 		pop_state<blend_func_state>(CTX->blend_func_stack,
 			[](const blend_func_state& old, const blend_func_state& cur)
 			{
-				return old.src == cur.src && old.dst == cur.dst;
+				return old == cur;
 			},
 			[](const blend_func_state& state)
 			{
-				glBlendFunc(state.src, state.dst);
+				apply_blend_func(state);
 			});
 	}
 
-	result on_resolution_changed()
+	void write_instance(float* instance_data, const float2& position, const float2& scale, float rotation, const float2& size, const float4& uv_rect, const float4& color, const float2& offset, float layer)
 	{
-		return {};
+		int idx = 0;
+		// translate, scale
+		instance_data[idx++] = position.x;
+		instance_data[idx++] = position.y;
+		instance_data[idx++] = scale.x;
+		instance_data[idx++] = scale.y;
+		// rotation, width, height, layer
+		instance_data[idx++] = rotation * glm::pi<float>() / 180.0f;
+		instance_data[idx++] = size.x;
+		instance_data[idx++] = size.y;
+		instance_data[idx++] = layer;
+		// uv rect
+		instance_data[idx++] = uv_rect[0];
+		instance_data[idx++] = uv_rect[1];
+		instance_data[idx++] = uv_rect[2];
+		instance_data[idx++] = uv_rect[3];
+		// color
+		instance_data[idx++] = color.x;
+		instance_data[idx++] = color.y;
+		instance_data[idx++] = color.z;
+		instance_data[idx++] = color.w;
+		// offset, normal map sign, rev
+		instance_data[idx++] = offset.x;
+		instance_data[idx++] = offset.y;
+		instance_data[idx++] = scale.x < 0 ? -1.0f : 1.0f;
+		instance_data[idx++] = 0;
 	}
 
-	std::tuple<result, std::shared_ptr<Itexture_info>> load_texture(const unsigned int* data, int w, int h)
+	void write_compact_instance(float* instance_data, const float2& position, const float2& scale, float rotation, const float2& size, const float4& uv_rect, const float4& color, const float2& offset, float layer)
 	{
-		auto ret = std::make_shared<texture_info>();
-		glGenTextures(1, &ret->resource);
-		glBindTexture(GL_TEXTURE_2D, ret->resource);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		ret->_width = w;
-		ret->_height = h;
-		return { {}, ret };
+		float radian = rotation * glm::pi<float>() / 180.0f;
+		float c = std::cos(radian);
+		float s = std::sin(radian);
+		// columns of rotation * size * scale
+		glm::vec2 axis_x = { c * size.x * scale.x, s * size.x * scale.x };
+		glm::vec2 axis_y = { -s * size.y * scale.y, c * size.y * scale.y };
+		// offset folded into translate
+		instance_data[0] = position.x - (axis_x.x * offset.x + axis_y.x * offset.y);
+		instance_data[1] = position.y - (axis_x.y * offset.x + axis_y.y * offset.y);
+
+		// halves carry 11 bits, so the axes lose sub pixel precision past 512 pixels. clamped to the half range instead of turning inf
+		const float HALF_MAX = 65504.0f;
+		axis_x = glm::clamp(axis_x, -HALF_MAX, HALF_MAX);
+		axis_y = glm::clamp(axis_y, -HALF_MAX, HALF_MAX);
+		const glm::uint packed[6] = {
+			glm::packHalf2x16(axis_x),
+			glm::packHalf2x16(axis_y),
+			glm::packUnorm2x16({ uv_rect.x, uv_rect.y }),
+			glm::packUnorm2x16({ uv_rect.z, uv_rect.w }),
+			glm::packUnorm4x8({ color.x, color.y, color.z, color.w }),
+			glm::packHalf2x16({ scale.x < 0 ? -1.0f : 1.0f, layer }),
+		};
+		memcpy(instance_data + 2, packed, sizeof(packed));
 	}
 
-	std::tuple<result, std::shared_ptr<Itexture_info>> load_texture(const std::string& path)
+	// bounds of the current camera when it culls
+	const float4* current_cull_rect()
 	{
-		const auto binary = load_data(path);
-		if (binary.empty())
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().culling == false)
 		{
-			return { {.type = result_type::fail, .error_code = 1, .msg = "invalid path" }, nullptr };
+			return nullptr;
 		}
-		int nr_channels = {};
-		std::shared_ptr<texture_info> info = std::make_shared<texture_info>();
-		stbi_set_flip_vertically_on_load(true);
-		unsigned char* data = stbi_load_from_memory((const unsigned char*)binary.data(), static_cast<int>(binary.size()), &info->_width, &info->_height, &nr_channels, 0);
-		if (data)
+		return &CTX->camera_stack.top().world_rect;
+	}
+
+	command_list* current_command_list()
+	{
+		if (CTX->camera_stack.empty())
 		{
-			glGenTextures(1, &info->resource);
-			glBindTexture(GL_TEXTURE_2D, info->resource);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			return nullptr;
+		}
+		return CTX->camera_stack.top().commands;
+	}
 
-			int channel = {};
-			if (nr_channels == 4)
-			{
-				channel = GL_RGBA;
-			}
-			else if (nr_channels == 3)
-			{
-				channel = GL_RGB;
-			}
-			glTexImage2D(GL_TEXTURE_2D, 0, channel, info->_width, info->_height, 0, channel, GL_UNSIGNED_BYTE, data);
-			glGenerateMipmap(GL_TEXTURE_2D);
-			stbi_image_free(data);
+	result execute_command_list(command_list* list);
+
+	// pending mesh::draw calls land before any other immediate draw or state change
+	void flush_mesh_batch()
+	{
+		if (CTX->camera_stack.empty())
+		{
+			return;
 		}
-		else
+		auto* batch = CTX->camera_stack.top().mesh_batch;
+		if (batch && batch->commands.empty() == false)
 		{
-			return { {.type = result_type::fail, .error_code = 2, .msg = "fail to load texture" }, nullptr };
+			execute_command_list(batch);
 		}
-		return { {}, info };
 	}
-}
 
-namespace imr::camera
-{
-	result begin(const begin_args& args)
+	// points the camera block at the current camera
+	void update_camera_block()
 	{
-		assert(args.frame_buffer);
-		result ret;
-		auto& state = CTX->camera_stack.emplace();
-		state.begin = true;
-		state.frame = args.frame_buffer;
-		state.frame->bind();
+		if (CTX->camera_stack.empty())
+		{
+			return;
+		}
+		auto& state = CTX->camera_stack.top();
+		camera_block block = {};
+		block.projection = state.projection;
+		block.view = state.view;
+		block.resolution_time.x = static_cast<float>(state.frame->width());
+		block.resolution_time.y = static_cast<float>(state.frame->height());
+		block.resolution_time.z = std::chrono::duration<float>(std::chrono::steady_clock::now() - CTX->start_time).count();
+		glBindBuffer(GL_UNIFORM_BUFFER, CTX->camera_ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera_block), &block);
+		CTX->gl_state.counters.upload_bytes += sizeof(camera_block);
+	}
 
-		switch (args.origin)
+	// built-in instancing program for the texture, array pages need the sampler2DArray variants
+	program* instancing_program(const Itexture_info* texture, bool compact)
+	{
+		auto& builtin = CTX->builtin_programs;
+		if (texture && texture->is_array())
 		{
-		case center:
+			return CTX->get_program(compact ? builtin.instancing_compact_array : builtin.instancing_array);
+		}
+		return CTX->get_program(compact ? builtin.instancing_compact : builtin.instancing);
+	}
+
+	bool is_same_material(const draw_command& lh, const draw_command& rh)
+	{
+		if (lh.type != rh.type || lh.program != rh.program)
+		{
+			return false;
+		}
+		for (int i = 0; i < draw_command::MAX_TEXTURE_COUNT; ++i)
+		{
+			if (lh.textures[i] != rh.textures[i])
+			{
+				return false;
+			}
+		}
+		return lh.compact_instance == rh.compact_instance && lh.blend == rh.blend;
+	}
+
+	int instance_stream_size(const draw_command& cmd)
+	{
+		return cmd.instance_count * (cmd.compact_instance ? instancing_state::COMPACT_INSTANCE_FORMAT_SIZE : instancing_state::INSTANCE_FORMAT_SIZE);
+	}
+
+	// 16 bit indices whenever the vertices fit, 32 bit ones only for merged meshes past 65536 vertices
+	bool use_short_indices(const draw_command& cmd)
+	{
+		return cmd.vertex_count <= 0x10000;
+	}
+
+	int index_stream_size(const draw_command& cmd)
+	{
+		int size = cmd.index_count * (use_short_indices(cmd) ? sizeof(unsigned short) : sizeof(uint32_t));
+		return (size + 3) / 4 * 4;
+	}
+
+	void copy_indices(void* dst, const draw_command& cmd, const uint32_t* indices)
+	{
+		if (use_short_indices(cmd))
+		{
+			auto* short_indices = static_cast<unsigned short*>(dst);
+			for (int i = 0; i < cmd.index_count; ++i)
+			{
+				short_indices[i] = static_cast<unsigned short>(indices[i]);
+			}
+		}
+		else
+		{
+			memcpy(dst, indices, cmd.index_count * sizeof(uint32_t));
+		}
+	}
+
+	// draws instances already written to the vertex stream at base
+	result draw_streamed_instances(const draw_command& cmd, int base)
+	{
+		auto* current_program = cmd.program;
+		current_program->use();
+
+		// built-in programs read the camera block, programs without it still take the matrices as uniforms 0 and 1
+		if (current_program->has_uniform_location(0))
+		{
+			auto& cam_state = CTX->camera_stack.top();
+			glUniformMatrix4fv(
+				current_program->get_uniform_location(0),
+				1,
+				GL_FALSE,
+				glm::value_ptr(cam_state.projection)
+			);
+			glUniformMatrix4fv(
+				current_program->get_uniform_location(1),
+				1,
+				GL_FALSE,
+				glm::value_ptr(cam_state.view)
+			);
+		}
+
+		// texture, the primitive program samples none
+		if (current_program->has_uniform_location(TEXTURE_REG_0))
+		{
+			glUniform1i(current_program->get_uniform_location(TEXTURE_REG_0), 0);
+			assert(cmd.textures[0] != nullptr);
+			CTX->gl_state.active_texture(0);
+			cmd.textures[0]->bind();
+			bind_multi_textures(current_program, cmd.textures[1], cmd.textures[2], cmd.textures[3], cmd.textures[0]->is_array());
+		}
+
+		CTX->gl_state.bind_vertex_array(CTX->get_instancing_vao(current_program));
+		CTX->vertex_stream->bind();
+		GL_ASSERT();
+
+#define VERTEX_ATRIB_POINTER(reg, offset) \
+{ \
+	auto loc = current_program->get_attrib_location(reg); \
+	glVertexAttribPointer(loc, 4, GL_FLOAT, false, instancing_state::INSTANCE_FORMAT_SIZE, (void*)(intptr_t)(base + offset * sizeof(float))); \
+}
+
+#define COMPACT_VERTEX_ATRIB_POINTER(reg, count, type, normalized, offset) \
+{ \
+	auto loc = current_program->get_attrib_location(reg); \
+	glVertexAttribPointer(loc, count, type, normalized, instancing_state::COMPACT_INSTANCE_FORMAT_SIZE, (void*)(intptr_t)(base + offset)); \
+}
+
+		if (cmd.compact_instance)
+		{
+			COMPACT_VERTEX_ATRIB_POINTER(1, 2, GL_FLOAT, GL_FALSE, 0);
+			COMPACT_VERTEX_ATRIB_POINTER(2, 4, GL_HALF_FLOAT, GL_FALSE, 8);
+			COMPACT_VERTEX_ATRIB_POINTER(3, 4, GL_UNSIGNED_SHORT, GL_TRUE, 16);
+			COMPACT_VERTEX_ATRIB_POINTER(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, 24);
+			COMPACT_VERTEX_ATRIB_POINTER(5, 2, GL_HALF_FLOAT, GL_FALSE, 28);
+		}
+		else
+		{
+			VERTEX_ATRIB_POINTER(1, 0);
+			VERTEX_ATRIB_POINTER(2, 4);
+			VERTEX_ATRIB_POINTER(3, 8);
+			VERTEX_ATRIB_POINTER(4, 12);
+			VERTEX_ATRIB_POINTER(5, 16);
+		}
+		GL_ASSERT();
+
+		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, cmd.instance_count);
+		GL_ASSERT();
+		auto& counters = CTX->gl_state.counters;
+		counters.draw_calls++;
+		counters.instances += cmd.instance_count;
+		counters.vertices += 4 * static_cast<size_t>(cmd.instance_count);
+		return {};
+	}
+
+	result draw_instances(const draw_command& cmd, const float* instances)
+	{
+		return draw_streamed_instances(cmd, CTX->vertex_stream->write(instances, instance_stream_size(cmd)));
+	}
+
+	// draws a mesh whose vertices and indices are already written to the streams
+	result draw_streamed_mesh(const draw_command& cmd, int vertex_base, int index_base, const vert_attrib_pointer* attrib_pointers, const uniform_value* uniforms, const float* uniform_data)
+	{
+		if (cmd.index_count == 0)
+		{
+			return {};
+		}
+		auto* current_program = cmd.program;
+		current_program->use();
+		GL_ASSERT();
+
+		for (int i = 0; i < draw_command::MAX_TEXTURE_COUNT; ++i)
+		{
+			if (cmd.textures[i])
+			{
+				glUniform1i(current_program->get_uniform_location(texture_regs[i]), i);
+				CTX->gl_state.active_texture(i);
+				cmd.textures[i]->bind();
+			}
+		}
+
+		for (int i = 0; i < cmd.uniform_count; ++i)
+		{
+			auto& u = uniforms[i];
+			if (u.type == uniform_value::mat4)
+			{
+				glUniformMatrix4fv(current_program->get_uniform_location(u.location), u.length, GL_FALSE, uniform_data + u.offset);
+			}
+			else
+			{
+				glUniform4fv(current_program->get_uniform_location(u.location), u.length, uniform_data + u.offset);
+			}
+		}
+
+		// built-in programs read the camera block, programs without it take both matrices at uniform 0
+		if (cmd.use_project_view_matrix && current_program->has_uniform_location(0))
+		{
+			auto& cam_state = CTX->camera_stack.top();
+			// uProjectionMatrix, uViewMatrix
+			const glm::mat4 buf[2] = { cam_state.projection, cam_state.view };
+			glUniformMatrix4fv(current_program->get_uniform_location(0), 2, GL_FALSE, glm::value_ptr(buf[0]));
+		}
+
+		GL_ASSERT();
+
+		// vao   glVertexAttribPointer  ߻
+		CTX->gl_state.bind_vertex_array(CTX->temp_vao);
+		CTX->vertex_stream->bind();
+		uint32_t enabled = 0;
+		for (int i = 0; i < cmd.attrib_count; ++i)
+		{
+			auto& p = attrib_pointers[i];
+			GLint location = current_program->get_attrib_location(p.location);
+			assert(location >= 0 && location < 32);
+			glVertexAttribPointer(location, p.count, GL_FLOAT, GL_FALSE, p.stride * sizeof(float), (void*)(intptr_t)(vertex_base + p.offset * sizeof(float)));
+			enabled |= 1u << location;
+		}
+		// arrays a previous layout left enabled would fetch through stale pointers
+		const uint32_t changed = enabled ^ CTX->temp_vao_attribs;
+		for (GLuint location = 0; location < 32; ++location)
+		{
+			if ((changed & (1u << location)) == 0)
+			{
+				continue;
+			}
+			if (enabled & (1u << location))
+			{
+				glEnableVertexAttribArray(location);
+			}
+			else
+			{
+				glDisableVertexAttribArray(location);
+			}
+		}
+		CTX->temp_vao_attribs = enabled;
+
+		// the element array binding belongs to the vao
+		CTX->index_stream->bind();
+		glDrawElements(GL_TRIANGLES, cmd.index_count, use_short_indices(cmd) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)(intptr_t)index_base);
+		GL_ASSERT();
+		CTX->gl_state.counters.draw_calls++;
+		CTX->gl_state.counters.vertices += cmd.vertex_count;
+		return {};
+	}
+
+	result draw_mesh(const draw_command& cmd, const float* vertices, const uint32_t* indices, const vert_attrib_pointer* attrib_pointers, const uniform_value* uniforms, const float* uniform_data)
+	{
+		if (cmd.index_count == 0)
+		{
+			return {};
+		}
+		// binding the index stream changes the element array of the bound vao, so the mesh vao takes it
+		CTX->gl_state.bind_vertex_array(CTX->temp_vao);
+		auto vertex_base = CTX->vertex_stream->write(vertices, cmd.vertex_count * cmd.vertex_stride * sizeof(float));
+		auto [index_data, index_base] = CTX->index_stream->map(index_stream_size(cmd));
+		if (index_data)
+		{
+			copy_indices(index_data, cmd, indices);
+		}
+		CTX->index_stream->unmap();
+		return draw_streamed_mesh(cmd, vertex_base, index_base, attrib_pointers, uniforms, uniform_data);
+	}
+
+	void record_instances(command_list* list, const draw_command& cmd, const float* instances)
+	{
+		auto instance_offset = static_cast<int>(list->instances.size());
+		auto format_count = cmd.compact_instance ? instancing_state::COMPACT_INSTANCE_FORMAT_COUNT : instancing_state::INSTANCE_FORMAT_COUNT;
+		list->instances.insert(list->instances.end(), instances, instances + cmd.instance_count * format_count);
+
+		// instances of neighbouring commands are contiguous, so a merge only grows the count
+		if (list->commands.size() > 0 && is_same_material(list->commands.back(), cmd))
+		{
+			list->commands.back().instance_count += cmd.instance_count;
+			return;
+		}
+		auto& item = list->commands.emplace_back(cmd);
+		item.instance_offset = instance_offset;
+	}
+
+	template <typename T>
+	void record_mesh(command_list* list, const draw_command& cmd, const float* vertices, const T* indices, const vert_attrib_pointer* attrib_pointers, const uniform_value* uniforms, const float* uniform_data)
+	{
+		auto can_merge = [&](const draw_command& last)
+		{
+			if (is_same_material(last, cmd) == false
+				|| last.use_project_view_matrix != cmd.use_project_view_matrix
+				|| last.vertex_stride != cmd.vertex_stride
+				|| last.attrib_count != cmd.attrib_count
+				|| last.uniform_count > 0
+				|| cmd.uniform_count > 0)
+			{
+				return false;
+			}
+			for (int i = 0; i < cmd.attrib_count; ++i)
+			{
+				auto& lh = list->attrib_pointers[last.attrib_offset + i];
+				auto& rh = attrib_pointers[i];
+				if (lh.location != rh.location || lh.count != rh.count || lh.stride != rh.stride || lh.offset != rh.offset)
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		uint32_t base_vertex = 0;
+		draw_command* item = {};
+		if (list->commands.size() > 0 && can_merge(list->commands.back()))
+		{
+			item = &list->commands.back();
+			base_vertex = static_cast<uint32_t>(item->vertex_count);
+			item->vertex_count += cmd.vertex_count;
+			item->index_count += cmd.index_count;
+		}
+		else
+		{
+			item = &list->commands.emplace_back(cmd);
+			item->vertex_offset = static_cast<int>(list->vertices.size());
+			item->index_offset = static_cast<int>(list->indices.size());
+			item->attrib_offset = static_cast<int>(list->attrib_pointers.size());
+			item->uniform_offset = static_cast<int>(list->uniforms.size());
+			list->attrib_pointers.insert(list->attrib_pointers.end(), attrib_pointers, attrib_pointers + cmd.attrib_count);
+			for (int i = 0; i < cmd.uniform_count; ++i)
+			{
+				auto& u = list->uniforms.emplace_back(uniforms[i]);
+				u.offset = static_cast<int>(list->uniform_data.size());
+				auto length = uniforms[i].length * (uniforms[i].type == uniform_value::mat4 ? 16 : 4);
+				list->uniform_data.insert(list->uniform_data.end(), uniform_data + uniforms[i].offset, uniform_data + uniforms[i].offset + length);
+			}
+		}
+		list->vertices.insert(list->vertices.end(), vertices, vertices + cmd.vertex_count * cmd.vertex_stride);
+		for (int i = 0; i < cmd.index_count; ++i)
+		{
+			list->indices.push_back(indices[i] + base_vertex);
+		}
+	}
+
+	result execute_command_list(command_list* list)
+	{
+		// the whole list goes up in one mapping per stream, instances first and mesh vertices after them.
+		// a list past half of a ring falls back to an upload per command
+		const int instances_size = static_cast<int>(list->instances.size() * sizeof(float));
+		const int vertices_offset = (instances_size + 15) / 16 * 16;
+		const int vertices_size = vertices_offset + static_cast<int>(list->vertices.size() * sizeof(float));
+		int indices_size = 0;
+		for (auto& cmd : list->commands)
+		{
+			if (cmd.type == draw_command::mesh)
+			{
+				indices_size += index_stream_size(cmd);
+			}
+		}
+		const bool single_upload = vertices_size <= CTX->vertex_stream->capacity() / 2 && indices_size <= CTX->index_stream->capacity() / 2;
+
+		int vertex_base = 0;
+		int index_base = 0;
+		if (single_upload && vertices_size > 0)
+		{
+			auto [data, base] = CTX->vertex_stream->map(vertices_size);
+			if (data)
+			{
+				std::copy(list->instances.begin(), list->instances.end(), static_cast<float*>(data));
+				std::copy(list->vertices.begin(), list->vertices.end(), reinterpret_cast<float*>(static_cast<char*>(data) + vertices_offset));
+			}
+			CTX->vertex_stream->unmap();
+			vertex_base = base;
+		}
+		if (single_upload && indices_size > 0)
+		{
+			CTX->gl_state.bind_vertex_array(CTX->temp_vao);
+			auto [data, base] = CTX->index_stream->map(indices_size);
+			if (data)
+			{
+				auto* dst = static_cast<char*>(data);
+				for (auto& cmd : list->commands)
+				{
+					if (cmd.type == draw_command::mesh)
+					{
+						copy_indices(dst, cmd, list->indices.data() + cmd.index_offset);
+						dst += index_stream_size(cmd);
+					}
+				}
+			}
+			CTX->index_stream->unmap();
+			index_base = base;
+		}
+
+		const blend_func_state* blend = {};
+		for (auto& cmd : list->commands)
+		{
+			if (blend == nullptr || *blend != cmd.blend)
+			{
+				blend = &cmd.blend;
+				apply_blend_func(*blend);
+			}
+			if (cmd.type == draw_command::instancing)
+			{
+				if (single_upload)
+				{
+					IMRRESULT(draw_streamed_instances(cmd, vertex_base + cmd.instance_offset * static_cast<int>(sizeof(float))));
+				}
+				else
+				{
+					IMRRESULT(draw_instances(cmd, &list->instances[cmd.instance_offset]));
+				}
+			}
+			else if (single_upload)
+			{
+				IMRRESULT(draw_streamed_mesh(
+					cmd,
+					vertex_base + vertices_offset + cmd.vertex_offset * static_cast<int>(sizeof(float)),
+					index_base,
+					list->attrib_pointers.data() + cmd.attrib_offset,
+					list->uniforms.data() + cmd.uniform_offset,
+					list->uniform_data.data()
+				));
+				index_base += index_stream_size(cmd);
+			}
+			else
+			{
+				IMRRESULT(draw_mesh(
+					cmd,
+					list->vertices.data() + cmd.vertex_offset,
+					list->indices.data() + cmd.index_offset,
+					list->attrib_pointers.data() + cmd.attrib_offset,
+					list->uniforms.data() + cmd.uniform_offset,
+					list->uniform_data.data()
+				));
+			}
+		}
+		if (blend && CTX->blend_func_stack.empty() == false)
+		{
+			apply_blend_func(CTX->blend_func_stack.top());
+		}
+		list->clear();
+		return {};
+	}
+
+	result on_resolution_changed()
+	{
+		return {};
+	}
+
+	std::tuple<result, std::shared_ptr<Itexture_info>> load_texture(const unsigned int* data, int w, int h)
+	{
+		auto ret = std::make_shared<texture_info>();
+		glGenTextures(1, &ret->resource);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, ret->resource);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, 0);
+		CTX->gl_state.counters.upload_bytes += static_cast<size_t>(w) * h * 4;
+		ret->_width = w;
+		ret->_height = h;
+		return { result{}, ret };
+	}
+
+	// mipmapped 2d texture from decoded rgb or rgba pixels
+	void upload_texture(texture_info& info, const unsigned char* data, int nr_channels)
+	{
+		glGenTextures(1, &info.resource);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, info.resource);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		int channel = {};
+		if (nr_channels == 4)
+		{
+			channel = GL_RGBA;
+		}
+		else if (nr_channels == 3)
+		{
+			channel = GL_RGB;
+		}
+		glTexImage2D(GL_TEXTURE_2D, 0, channel, info._width, info._height, 0, channel, GL_UNSIGNED_BYTE, data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		CTX->gl_state.counters.upload_bytes += static_cast<size_t>(info._width) * info._height * nr_channels;
+	}
+
+	// pre-compressed levels straight from a KTX, see imr_texconv
+	// etc2 is core in gles3, desktop gl has it from 4.3 or with ARB_ES3_compatibility
+	bool etc2_supported()
+	{
+#ifdef _WIN32
+		GLint major = 0;
+		GLint minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		return major > 4 || (major == 4 && minor >= 3) || extension_supported("GL_ARB_ES3_compatibility");
+#else
+		return true;
+#endif
+	}
+
+	result upload_ktx(texture_info& info, const std::vector<char>& binary)
+	{
+		ktx::image image = {};
+		if (ktx::parse(binary.data(), binary.size(), image) == false)
+		{
+			return { .type = result_type::fail, .error_code = 3, .msg = "invalid ktx" };
+		}
+		// nothing decodes etc2 on the cpu, convert the source image instead where the gl lacks it
+		if (etc2_supported() == false)
+		{
+			return { .type = result_type::fail, .error_code = 4, .msg = "etc2 needs gles3, gl 4.3 or ARB_ES3_compatibility" };
+		}
+		const GLsizei level_count = static_cast<GLsizei>(image.levels.size());
+		glGenTextures(1, &info.resource);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D, info.resource);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+		// errors raised before the upload aren't the upload's
+		while (glGetError() != GL_NO_ERROR)
+		{
+		}
+		for (GLsizei i = 0; i < level_count; ++i)
+		{
+			auto& level = image.levels[i];
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, image.head.gl_internal_format, level.width, level.height, 0, level.size, level.data);
+			// e.g. a level size that doesn't match its dimensions
+			if (GLenum error = glGetError(); error != GL_NO_ERROR)
+			{
+				CTX->gl_state.forget_texture(info.resource);
+				glDeleteTextures(1, &info.resource);
+				info.resource = 0;
+				return { .type = result_type::fail, .error_code = 5, .msg = "compressed upload failed, gl error " + std::to_string(error) };
+			}
+			CTX->gl_state.counters.upload_bytes += level.size;
+		}
+		info._width = static_cast<int>(image.head.pixel_width);
+		info._height = static_cast<int>(image.head.pixel_height);
+		return {};
+	}
+
+	std::tuple<result, std::shared_ptr<Itexture_info>> load_texture(const std::string& path)
+	{
+		const auto binary = load_data(path);
+		if (binary.empty())
+		{
+			return { {.type = result_type::fail, .error_code = 1, .msg = "invalid path" }, nullptr };
+		}
+		if (ktx::is_ktx(binary.data(), binary.size()))
+		{
+			auto info = std::make_shared<texture_info>();
+			auto res = upload_ktx(*info, binary);
+			if (failed(res))
+			{
+				return { res, nullptr };
+			}
+			return { result{}, info };
+		}
+		int nr_channels = {};
+		std::shared_ptr<texture_info> info = std::make_shared<texture_info>();
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char* data = stbi_load_from_memory((const unsigned char*)binary.data(), static_cast<int>(binary.size()), &info->_width, &info->_height, &nr_channels, 0);
+		if (data)
+		{
+			upload_texture(*info, data, nr_channels);
+			stbi_image_free(data);
+		}
+		else
+		{
+			return { {.type = result_type::fail, .error_code = 2, .msg = "fail to load texture" }, nullptr };
+		}
+		return { result{}, info };
+	}
+
+	size_t render_target_desc::bytes() const
+	{
+		size_t texel = 0;
+		for (int i = 0; i < color_count; ++i)
+		{
+			switch (color_formats[i])
+			{
+			case render_target_format::r8: texel += 1; break;
+			case render_target_format::rgba16f: texel += 8; break;
+			default: texel += 4; break;
+			}
+		}
+		// DEPTH_COMPONENT32F
+		texel += depth ? 4 : 0;
+		return static_cast<size_t>(width) * height * texel;
+	}
+
+	namespace
+	{
+		pooled_render_target& find_render_target(const render_target_desc& desc)
+		{
+			for (auto& pooled : CTX->render_targets)
+			{
+				if (pooled.free() && pooled.target->desc() == desc)
+				{
+					pooled.idle_frames = 0;
+					return pooled;
+				}
+			}
+			auto target = std::make_shared<frame_buffer>();
+			target->create(desc);
+			return CTX->render_targets.emplace_back(pooled_render_target{ .target = target });
+		}
+	}
+
+	std::shared_ptr<Iframe_buffer> acquire_render_target(const render_target_desc& desc)
+	{
+		return find_render_target(desc).target;
+	}
+
+	Iframe_buffer* acquire_transient_render_target(const render_target_desc& desc)
+	{
+		auto& pooled = find_render_target(desc);
+		pooled.transient = true;
+		return pooled.target.get();
+	}
+
+	void update_render_targets(int max_idle_frames)
+	{
+		auto& targets = CTX->render_targets;
+		for (auto& pooled : targets)
+		{
+			pooled.transient = false;
+			pooled.idle_frames = pooled.free() ? pooled.idle_frames + 1 : 0;
+		}
+		std::erase_if(targets, [max_idle_frames](const pooled_render_target& pooled) { return pooled.idle_frames > max_idle_frames; });
+	}
+
+	render_target_stats get_render_target_stats()
+	{
+		render_target_stats ret = { .bytes = frame_buffer::total_bytes() };
+		for (auto& pooled : CTX->render_targets)
+		{
+			ret.pooled_count++;
+			if (pooled.free())
+			{
+				ret.idle_count++;
+				ret.idle_bytes += pooled.target->desc().bytes();
+			}
+		}
+		return ret;
+	}
+
+	result read_pixels(Iframe_buffer* frame, std::vector<uint8_t>& out, int attachment_idx)
+	{
+		assert(frame);
+		// the target of a running camera may still have recorded draws
+		if (CTX->camera_stack.empty() == false)
+		{
+			return { .type = result_type::fail, .error_code = 1, .msg = "read_pixels inside camera::begin/end" };
+		}
+		out.resize(static_cast<size_t>(frame->width()) * frame->height() * 4);
+		frame->bind();
+		// the backbuffer has no color texture
+		glReadBuffer(frame->get_color_texture() == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0 + attachment_idx);
+		glReadPixels(0, 0, frame->width(), frame->height(), GL_RGBA, GL_UNSIGNED_BYTE, out.data());
+		frame->unbind();
+		GL_ASSERT();
+		return {};
+	}
+
+	const Itexture_info* async_texture_info::current() const
+	{
+		return texture ? texture.get() : CTX->white_texture_info.get();
+	}
+
+	std::shared_ptr<Itexture_info> load_texture_async(const std::string& path)
+	{
+		auto ret = std::make_shared<async_texture_info>();
+		ret->texture_name = path;
+		auto decoded = std::make_shared<decoded_texture>();
+		decoded->target = ret;
+		CTX->get_loaders()->push([path, decoded]() -> result
+		{
+			if (decoded->target.expired())
+			{
+				return {};
+			}
+			auto binary = load_data(path);
+			if (binary.empty())
+			{
+				return { .type = result_type::fail, .error_code = 1, .msg = "no texture data" };
+			}
+			if (ktx::is_ktx(binary.data(), binary.size()))
+			{
+				decoded->compressed = std::move(binary);
+				return {};
+			}
+			// per thread flip flag, the global one belongs to load_texture
+			stbi_set_flip_vertically_on_load_thread(true);
+			decoded->pixels = stbi_load_from_memory((const unsigned char*)binary.data(), static_cast<int>(binary.size()), &decoded->width, &decoded->height, &decoded->channels, 0);
+			if (decoded->pixels == nullptr)
+			{
+				return { .type = result_type::fail, .error_code = 2, .msg = "texture decode failed" };
+			}
+			return {};
+		},
+		[decoded](const result& load_result)
+		{
+			// failed loads are queued as well, so their handle finishes as the white texture
+			decoded->load_result = load_result;
+			std::lock_guard<std::mutex> lock(CTX->decoded_mutex);
+			CTX->decoded_textures.push_back(std::move(*decoded));
+		});
+		return ret;
+	}
+
+	void update_texture_uploads(size_t byte_budget)
+	{
+		size_t spent = 0;
+		while (spent == 0 || spent < byte_budget)
+		{
+			decoded_texture decoded = {};
+			{
+				std::lock_guard<std::mutex> lock(CTX->decoded_mutex);
+				if (CTX->decoded_textures.empty())
+				{
+					return;
+				}
+				decoded = std::move(CTX->decoded_textures.front());
+				CTX->decoded_textures.pop_front();
+			}
+			auto target = decoded.target.lock();
+			if (target && decoded.compressed.empty() == false)
+			{
+				auto info = std::make_shared<texture_info>();
+				info->texture_name = target->texture_name;
+				decoded.load_result = upload_ktx(*info, decoded.compressed);
+				if (succeed(decoded.load_result))
+				{
+					target->texture = info;
+				}
+				spent += decoded.compressed.size();
+			}
+			else if (target && decoded.pixels)
+			{
+				auto info = std::make_shared<texture_info>();
+				info->texture_name = target->texture_name;
+				info->_width = decoded.width;
+				info->_height = decoded.height;
+				upload_texture(*info, decoded.pixels, decoded.channels);
+				target->texture = info;
+				spent += static_cast<size_t>(decoded.width) * decoded.height * decoded.channels;
+			}
+			if (target)
+			{
+				target->load_result = decoded.load_result;
+				target->done = true;
+			}
+			if (decoded.pixels)
+			{
+				stbi_image_free(decoded.pixels);
+			}
+		}
+	}
+
+	std::tuple<result, std::vector<std::shared_ptr<Itexture_info>>> load_texture_array(const std::vector<std::string>& paths)
+	{
+		if (paths.empty())
+		{
+			return { {.type = result_type::fail, .error_code = 1, .msg = "no page" }, {} };
+		}
+
+		struct page
+		{
+			unsigned char* data = {};
+			int width = {};
+			int height = {};
+		};
+		std::vector<page> pages(paths.size());
+		auto free_pages = [&pages]()
+		{
+			for (auto& p : pages)
+			{
+				if (p.data)
+				{
+					stbi_image_free(p.data);
+				}
+			}
+		};
+
+		auto info = std::make_shared<texture_array_info>();
+		stbi_set_flip_vertically_on_load(true);
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			const auto binary = load_data(paths[i]);
+			if (binary.empty())
+			{
+				free_pages();
+				return { {.type = result_type::fail, .error_code = 1, .msg = "invalid path : " + paths[i] }, {} };
+			}
+			int nr_channels = {};
+			auto& p = pages[i];
+			p.data = stbi_load_from_memory((const unsigned char*)binary.data(), static_cast<int>(binary.size()), &p.width, &p.height, &nr_channels, 4);
+			if (p.data == nullptr)
+			{
+				free_pages();
+				return { {.type = result_type::fail, .error_code = 2, .msg = "fail to load texture : " + paths[i] }, {} };
+			}
+			info->_width = std::max(info->_width, p.width);
+			info->_height = std::max(info->_height, p.height);
+		}
+		info->layer_count = static_cast<int>(pages.size());
+
+		glGenTextures(1, &info->resource);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D_ARRAY, info->resource);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, info->_width, info->_height, info->layer_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+		// flipped rows, the top left of a smaller page is the top of the layer.
+		// the padding repeats the page's right column and bottom row, so filtering and mips at the page edge don't bleed
+		const size_t row_size = static_cast<size_t>(info->_width) * 4;
+		std::vector<unsigned char> layer(row_size * info->_height);
+		std::vector<std::shared_ptr<Itexture_info>> views(pages.size());
+		for (size_t i = 0; i < pages.size(); ++i)
+		{
+			auto& p = pages[i];
+			const size_t pad_rows = static_cast<size_t>(info->_height - p.height);
+			for (int y = 0; y < p.height; ++y)
+			{
+				unsigned char* row = &layer[(pad_rows + y) * row_size];
+				memcpy(row, p.data + static_cast<size_t>(y) * p.width * 4, static_cast<size_t>(p.width) * 4);
+				for (int x = p.width; x < info->_width; ++x)
+				{
+					memcpy(row + x * 4, row + (p.width - 1) * 4, 4);
+				}
+			}
+			for (size_t y = 0; y < pad_rows; ++y)
+			{
+				memcpy(&layer[y * row_size], &layer[pad_rows * row_size], row_size);
+			}
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(i), info->_width, info->_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+			CTX->gl_state.counters.upload_bytes += layer.size();
+
+			auto view = std::make_shared<texture_layer_info>();
+			view->array = info;
+			view->index = static_cast<int>(i);
+			view->page_size = { p.width, p.height };
+			view->texture_name = paths[i];
+			views[i] = view;
+		}
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		CTX->gl_state.bind_texture(GL_TEXTURE_2D_ARRAY, 0);
+		free_pages();
+		return { result{}, views };
+	}
+}
+
+namespace imr::camera
+{
+	// pending deferred draws must land before render state changes
+	void flush_commands()
+	{
+		if (auto* commands = current_command_list())
+		{
+			execute_command_list(commands);
+		}
+		flush_mesh_batch();
+	}
+
+	result begin(const begin_args& args)
+	{
+		assert(args.frame_buffer);
+		result ret;
+		if (CTX->camera_stack.empty())
+		{
+			// gl code outside imr (e.g. imgui) may have changed bindings since the last frame.
+			// nested passes keep the cache, everything they bind goes through it
+			CTX->gl_state.invalidate();
+			// no upload of the previous passes is still mapped
+			CTX->vertex_stream->grow_pending();
+			CTX->index_stream->grow_pending();
+		}
+		// the parent's recorded draws go first, the nested pass may draw to or over a texture they sample
+		flush_commands();
+		auto& state = CTX->camera_stack.emplace();
+		state.begin = true;
+		state.start_counters = CTX->gl_state.counters;
+		state.start_time = std::chrono::steady_clock::now();
+		// time elapsed queries can't nest, a nested pass is cpu timed
+		if (CTX->timer_query_supported && CTX->timer_query_active == false)
+		{
+			state.timer_query = CTX->acquire_timer_query();
+			glBeginQuery(TIME_ELAPSED, state.timer_query);
+			CTX->timer_query_active = true;
+		}
+		state.frame = args.frame_buffer;
+		state.frame->bind();
+		auto* commands = CTX->get_command_list(CTX->camera_stack.size() - 1);
+		state.commands = args.deferred ? commands : nullptr;
+		state.mesh_batch = args.deferred ? nullptr : commands;
+		state.culling = args.culling;
+
+		switch (args.origin)
+		{
+		case center:
 		{
 			float hw = state.frame->width() / 2.0f;
 			float hh = state.frame->height() / 2.0f;
@@ -964,6 +2514,7 @@ namespace imr::camera
 			state.projection = glm::orthoLH<float>(0, (float)state.frame->width(), hh, -hh, 0.01f, 1.0f);
 			break;
 		}
+		state.inverse_projection = glm::inverse(state.projection);
 
 		push_viewport({ .x = 0, .y = 0, .width = state.frame->width(), .height = state.frame->height() });
 
@@ -985,100 +2536,464 @@ namespace imr::camera
 			return ret;
 		}
 
-		auto& state = CTX->camera_stack.top();
-		CTX->camera_stack.pop();
+		auto& state = CTX->camera_stack.top();
+		// sprites still queued by begin_layered or begin_try_batch are drawn, not dropped
+		if (state.layered)
+		{
+			ret = imr::sprite::end_layered();
+		}
+		else if (state.try_batch)
+		{
+			ret = imr::sprite::end_try_batch();
+		}
+		if (state.commands)
+		{
+			auto executed = execute_command_list(state.commands);
+			ret = failed(ret) ? ret : executed;
+		}
+		flush_mesh_batch();
+		if (state.timer_query)
+		{
+			glEndQuery(TIME_ELAPSED);
+			CTX->timer_query_active = false;
+		}
+		auto& recording = CTX->recording_stats;
+		recording.frame.cameras.push_back({
+			.depth = static_cast<int>(CTX->camera_stack.size()) - 1,
+			.size = { state.frame->width(), state.frame->height() },
+			.work = counters_since(state.start_counters),
+			.ms = elapsed_ms(state.start_time),
+		});
+		recording.pass_queries.push_back(state.timer_query);
+		auto* frame = state.frame;
+		CTX->camera_stack.pop();
+
+		// framebuffer and viewport return to the parent through the cache
+		pop_blend_func();
+		pop_viewport();
+		if (frame)
+		{
+			frame->unbind();
+		}
+		// nested camera (e.g. font glyph cache) returns to the parent target
+		if (CTX->camera_stack.empty() == false && CTX->camera_stack.top().frame)
+		{
+			CTX->camera_stack.top().frame->bind();
+			update_camera_block();
+		}
+
+		return ret;
+	}
+
+	void enable_depth_test()
+	{
+		flush_commands();
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	void disable_depth_test()
+	{
+		flush_commands();
+		glDisable(GL_DEPTH_TEST);
+	}
+
+	void clear(const float4& color)
+	{
+		flush_commands();
+		glClearColor(color.x, color.y, color.z, color.w);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// the xy part of a camera matrix folded with the screen <-> ndc mapping, out = x * p.x + y * p.y + t
+	struct point_transform
+	{
+		float2 x = {};
+		float2 y = {};
+		float2 t = {};
+	};
+
+	point_transform screen_to_world_transform(const camera_state& state)
+	{
+		const auto& iv = state.inverse_view_projection;
+		const float sx = 2.0f / static_cast<float>(state.frame->width());
+		const float sy = 2.0f / static_cast<float>(state.frame->height());
+		return {
+			.x = { iv[0][0] * sx, iv[0][1] * sx },
+			.y = { iv[1][0] * sy, iv[1][1] * sy },
+			.t = { iv[3][0] - iv[0][0] - iv[1][0], iv[3][1] - iv[0][1] - iv[1][1] },
+		};
+	}
+
+	point_transform world_to_screen_transform(const camera_state& state)
+	{
+		const auto& vp = state.view_projection;
+		const float hw = static_cast<float>(state.frame->width()) / 2.0f;
+		const float hh = static_cast<float>(state.frame->height()) / 2.0f;
+		return {
+			.x = { vp[0][0] * hw, vp[0][1] * hh },
+			.y = { vp[1][0] * hw, vp[1][1] * hh },
+			.t = { (vp[3][0] + 1.0f) * hw, (vp[3][1] + 1.0f) * hh },
+		};
+	}
+
+	static_assert(sizeof(float2) == sizeof(float) * 2, "points are loaded as packed xy pairs");
+
+	// two points per register, in and out may overlap exactly
+	void transform_points(const point_transform& m, const float2* in, float2* out, size_t count)
+	{
+		size_t i = 0;
+#if defined(IMR_SSE2)
+		const __m128 mx = _mm_setr_ps(m.x.x, m.x.y, m.x.x, m.x.y);
+		const __m128 my = _mm_setr_ps(m.y.x, m.y.y, m.y.x, m.y.y);
+		const __m128 mt = _mm_setr_ps(m.t.x, m.t.y, m.t.x, m.t.y);
+		for (; i + 2 <= count; i += 2)
+		{
+			const __m128 p = _mm_loadu_ps(&in[i].x);
+			const __m128 px = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+			const __m128 py = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+			_mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, mx), _mm_mul_ps(py, my)), mt));
+		}
+#elif defined(IMR_NEON)
+		const float32x4_t mx = vcombine_f32(vld1_f32(&m.x.x), vld1_f32(&m.x.x));
+		const float32x4_t my = vcombine_f32(vld1_f32(&m.y.x), vld1_f32(&m.y.x));
+		const float32x4_t mt = vcombine_f32(vld1_f32(&m.t.x), vld1_f32(&m.t.x));
+		for (; i + 2 <= count; i += 2)
+		{
+			const float32x4_t p = vld1q_f32(&in[i].x);
+			const float32x4_t px = vtrn1q_f32(p, p);
+			const float32x4_t py = vtrn2q_f32(p, p);
+			vst1q_f32(&out[i].x, vmlaq_f32(vmlaq_f32(mt, px, mx), py, my));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			const float2 p = in[i];
+			out[i] = float2(m.x.x * p.x + m.y.x * p.y + m.t.x, m.x.y * p.x + m.y.y * p.y + m.t.y);
+		}
+	}
+
+	result camera(const camera_args& args)
+	{
+		result ret;
+
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+		{
+			ret.type = fail;
+			ret.error_code = 1;
+			ret.msg = "begin camera not called";
+			return ret;
+		}
+
+		// recorded draws keep the matrices they were drawn with
+		flush_commands();
+
+		auto& state = CTX->camera_stack.top();
+		auto transform = glm::scale(state.view, { args.scale.x, args.scale.y, 1.0f });
+		transform = glm::rotate(transform, args.rotation, { 0.0f, 0.0f, 1.0f });
+		transform = glm::translate(transform, { std::roundf(args.position.x), std::roundf(args.position.y), 0.0f });
+		state.view = glm::inverse(transform);
+		state.view_projection = state.projection * state.view;
+		// inverse(projection * inverse(transform)) without another general inverse
+		state.inverse_view_projection = transform * state.inverse_projection;
+
+		// aabb of the four corners, the view may be rotated
+		const float w = static_cast<float>(state.frame->width());
+		const float h = static_cast<float>(state.frame->height());
+		float2 corners[4] = { { 0, h }, { w, 0 }, { 0, 0 }, { w, h } };
+		transform_points(screen_to_world_transform(state), corners, corners, 4);
+		state.world_rect = { corners[0], corners[0] };
+		for (auto& p : corners)
+		{
+			state.world_rect.x = std::min(state.world_rect.x, p.x);
+			state.world_rect.y = std::min(state.world_rect.y, p.y);
+			state.world_rect.z = std::max(state.world_rect.z, p.x);
+			state.world_rect.w = std::max(state.world_rect.w, p.y);
+		}
+		update_camera_block();
+		return ret;
+	}
+
+	const cull_stats& get_cull_stats()
+	{
+		return CTX->cull_stats;
+	}
+
+	void reset_cull_stats()
+	{
+		CTX->cull_stats = {};
+	}
+
+	std::tuple<result, float2> screen_to_world(const float2& scr_pos)
+	{
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+		{
+			return { {.type = fail, .error_code = 1, .msg = "no camera stack"}, {} };
+		}
+
+		float2 ret = {};
+		transform_points(screen_to_world_transform(CTX->camera_stack.top()), &scr_pos, &ret, 1);
+		return { result{}, ret };
+	}
+
+	std::tuple<result, float2> world_to_screen(const float2& world_pos)
+	{
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+		{
+			return { {.type = fail, .error_code = 1, .msg = "no camera stack"}, {} };
+		}
+
+		float2 ret = {};
+		transform_points(world_to_screen_transform(CTX->camera_stack.top()), &world_pos, &ret, 1);
+		return { result{}, ret };
+	}
+
+	result screen_to_world(std::span<const float2> scr_pos, std::span<float2> out)
+	{
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+		{
+			return { .type = fail, .error_code = 1, .msg = "no camera stack" };
+		}
+		if (out.size() < scr_pos.size())
+		{
+			return { .type = fail, .error_code = 2, .msg = "out is smaller than the input" };
+		}
+		transform_points(screen_to_world_transform(CTX->camera_stack.top()), scr_pos.data(), out.data(), scr_pos.size());
+		return {};
+	}
+
+	result world_to_screen(std::span<const float2> world_pos, std::span<float2> out)
+	{
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+		{
+			return { .type = fail, .error_code = 1, .msg = "no camera stack" };
+		}
+		if (out.size() < world_pos.size())
+		{
+			return { .type = fail, .error_code = 2, .msg = "out is smaller than the input" };
+		}
+		transform_points(world_to_screen_transform(CTX->camera_stack.top()), world_pos.data(), out.data(), world_pos.size());
+		return {};
+	}
+}
+
+namespace imr::stats
+{
+	void update()
+	{
+		auto* ctx = CTX;
+		auto& recording = ctx->recording_stats;
+		recording.frame.index = ctx->stats_frame_index++;
+		recording.frame.work = counters_since(ctx->frame_start_counters);
+		recording.frame.cpu_ms = elapsed_ms(ctx->frame_start_time);
+		ctx->frame_start_counters = ctx->gl_state.counters;
+		ctx->frame_start_time = std::chrono::steady_clock::now();
+		ctx->pending_stats.push_back(std::exchange(recording, {}));
+
+		// a disjoint event (e.g. a gpu clock change) spoils every timer in flight, those passes keep their cpu time
+		const bool disjoint = ctx->timer_query_supported && gpu_disjoint();
+		while (ctx->pending_stats.empty() == false)
+		{
+			auto& pending = ctx->pending_stats.front();
+			// frames stuck behind queries that never resolve are given up on
+			const bool give_up = disjoint || ctx->pending_stats.size() > context::MAX_PENDING_STATS;
+			bool available = true;
+			for (auto query : pending.pass_queries)
+			{
+				if (query && available)
+				{
+					GLuint result = GL_FALSE;
+					glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &result);
+					available = result == GL_TRUE;
+				}
+			}
+			if (available == false && give_up == false)
+			{
+				break;
+			}
+
+			auto& frame = pending.frame;
+			for (size_t i = 0; i < pending.pass_queries.size(); ++i)
+			{
+				auto query = pending.pass_queries[i];
+				if (query == 0)
+				{
+					continue;
+				}
+				if (available && disjoint == false)
+				{
+					auto& pass = frame.cameras[i];
+					pass.ms = query_elapsed_ns(query) / 1000000.0;
+					pass.gpu_timed = true;
+					frame.gpu_ms += pass.ms;
+				}
+				ctx->free_timer_queries.push_back(query);
+			}
 
-		pop_blend_func();
-		pop_viewport();
-		if (state.frame)
-		{
-			state.frame->unbind();
+			auto& history = ctx->stats_history;
+			if (history.size() >= HISTORY_SIZE)
+			{
+				history.erase(history.begin());
+			}
+			history.push_back(std::exchange(frame, {}));
+			ctx->pending_stats.pop_front();
 		}
-
-		return ret;
 	}
 
-	void enable_depth_test()
+	bool gpu_timer_supported()
 	{
-		glEnable(GL_DEPTH_TEST);
+		return CTX->timer_query_supported;
 	}
 
-	void disable_depth_test()
+	std::span<const frame> history()
 	{
-		glDisable(GL_DEPTH_TEST);
+		return CTX->stats_history;
 	}
 
-	void clear(const float4& color)
+	const frame& latest()
 	{
-		glClearColor(color.x, color.y, color.z, color.w);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		static const frame empty = {};
+		auto& history = CTX->stats_history;
+		return history.empty() ? empty : history.back();
 	}
+}
 
-	void screen_to_world_impl(const float2& scr_pos, float2& out)
+namespace imr::sprite
+{
+	result begin_try_batch()
 	{
+		if (CTX->camera_stack.empty())
+		{
+			return { .type = result_type::fail, .error_code = 1, .msg = "no camera contex" };
+		}
 		auto& state = CTX->camera_stack.top();
-		auto iv = glm::inverse(state.projection * state.view);
-		auto size = float2(static_cast<float>(state.frame->width()), static_cast<float>(state.frame->height()));
-		auto hsize = size / 2.0f;
-		auto p = 2.0f * (scr_pos - hsize) / size;
-		auto wpos = iv * glm::vec4{ p.x, p.y, 0, 1 };
-		out.x = wpos.x;
-		out.y = wpos.y;
+		if (state.batches.size() > 0)
+		{
+			return { .type = result_type::fail, .error_code = 2, .msg = "invaid batched data exist" };
+		}
+		if (state.layered)
+		{
+			return { .type = result_type::fail, .error_code = 3, .msg = "layered drawing already batches" };
+		}
+		state.try_batch = true;
+		return {};
 	}
 
-	result camera(const camera_args& args)
-	{
-		result ret;
+	result flush_batching();
 
-		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+	result begin_layered(const layered_args& args)
+	{
+		if (CTX->camera_stack.empty())
 		{
-			ret.type = fail;
-			ret.error_code = 1;
-			ret.msg = "begin camera not called";
-			return ret;
+			return { .type = result_type::fail, .error_code = 1, .msg = "no camera contex" };
 		}
-
 		auto& state = CTX->camera_stack.top();
-		state.view = glm::scale(state.view, { args.scale.x, args.scale.y, 1.0f });
-		state.view = glm::rotate(state.view, args.rotation, { 0.0f, 0.0f, 1.0f });
-		state.view = glm::translate(state.view, { std::roundf(args.position.x), std::roundf(args.position.y), 0.0f });
-		state.view = glm::inverse(state.view);
-		screen_to_world_impl({ 0, static_cast<float>(state.frame->height()) }, state.world_rect.xy);
-		screen_to_world_impl({ static_cast<float>(state.frame->width()), 0 }, state.world_rect.zw);
-		return ret;
+		if (state.layered || state.try_batch)
+		{
+			return { .type = result_type::fail, .error_code = 2, .msg = "layered or try batch already begun" };
+		}
+		state.layered = true;
+		state.y_sort = args.y_sort;
+		state.layered_sprites.clear();
+		state.layered_keys.clear();
+		state.layered_materials.clear();
+		return {};
 	}
 
-	std::tuple<result, float2> screen_to_world(const float2& scr_pos)
+	// layer 16 | depth 32 | material 16, submission order is kept by the stable sort
+	std::tuple<result, uint64_t> layered_key(camera_state& state, const draw_args& args)
 	{
-		if (CTX->camera_stack.empty() || CTX->camera_stack.top().begin == false)
+		if (args.layer < std::numeric_limits<int16_t>::min() || args.layer > std::numeric_limits<int16_t>::max())
 		{
-			return { {.type = fail, .error_code = 1, .msg = "no camera stack"}, {} };
+			return { {.type = result_type::fail, .error_code = 2, .msg = "layer out of int16 range" }, 0 };
+		}
+		auto batch_key = [](const Itexture_info* texture) { return texture ? texture->batch_key() : nullptr; };
+		const std::array<const Itexture_info*, 4> material = {
+			batch_key(args.texture_info), batch_key(args.texture_info_1), batch_key(args.texture_info_2), batch_key(args.texture_info_3)
+		};
+		auto& materials = state.layered_materials;
+		size_t material_id = materials.size();
+		// neighbours mostly share a material, search from the latest one
+		for (size_t i = materials.size(); i-- > 0;)
+		{
+			if (materials[i] == material)
+			{
+				material_id = i;
+				break;
+			}
+		}
+		if (material_id == materials.size())
+		{
+			if (materials.size() > 0xffff)
+			{
+				return { {.type = result_type::fail, .error_code = 3, .msg = "more than 65536 materials in one layered range" }, 0 };
+			}
+			materials.push_back(material);
 		}
 
-		float2 ret = {};
-		screen_to_world_impl(scr_pos, ret);
-		return { {}, ret };
+		uint64_t layer = static_cast<uint16_t>(static_cast<int16_t>(args.layer) ^ 0x8000);
+		uint64_t depth = sortable_float(state.y_sort ? args.position.y : args.depth);
+		return { result{}, (layer << 48) | (depth << 16) | material_id };
 	}
-}
 
-namespace imr::sprite
-{
-	result begin_try_batch()
+	result end_layered()
 	{
-		if (CTX->camera_stack.empty())
+		if (CTX->camera_stack.empty() || CTX->camera_stack.top().layered == false)
 		{
-			return { .type = result_type::fail, .error_code = 1, .msg = "no camera contex" };
+			return { .type = result_type::fail, .error_code = 1, .msg = "no camera contex or didn't begin layered" };
 		}
 		auto& state = CTX->camera_stack.top();
-		if (state.batches.size() > 0)
+		state.layered = false;
+
+		radix_sort(state.layered_keys, CTX->sort_scratch);
+
+		// sorted runs of one material become one instanced draw
+		state.try_batch = true;
+		result ret = {};
+		for (auto& item : state.layered_keys)
 		{
-			return { .type = result_type::fail, .error_code = 2, .msg = "invaid batched data exist" };
+			ret = draw(state.layered_sprites[item.value]);
+			if (failed(ret))
+			{
+				break;
+			}
 		}
-		state.try_batch = true;
-		return {};
+		if (succeed(ret))
+		{
+			ret = flush_batching();
+		}
+		state.batches.clear();
+		state.try_batch = false;
+		state.layered_sprites.clear();
+		state.layered_keys.clear();
+		return ret;
 	}
 
-	result flush_batching();
+	// a deferred camera draws sprites as single instances so they can merge with their neighbours
+	result record_sprite(command_list* commands, const Itexture_info* texture, const Itexture_info* texture_1, const Itexture_info* texture_2, const Itexture_info* texture_3, const float2& position, const float2& scale, float rotation, const float2& size, const float4& uv_rect, const float4& color, const float2& offset)
+	{
+		auto* current_program = instancing_program(texture, false);
+		if (current_program == nullptr)
+		{
+			return { .type = result_type::fail, .error_code = 2, .msg = "invalid program" };
+		}
+
+		float instance_data[instancing_state::INSTANCE_FORMAT_COUNT] = {};
+		write_instance(instance_data, position, scale, rotation, size, uv_rect, color, offset, static_cast<float>(texture->layer()));
+		// the sprite program never flips the normal map
+		instance_data[instancing_state::INSTANCE_FORMAT_COUNT - 2] = 1.0f;
+
+		draw_command cmd = {};
+		cmd.type = draw_command::instancing;
+		cmd.program = current_program;
+		cmd.textures[0] = texture->batch_key();
+		cmd.textures[1] = texture_1 ? texture_1->batch_key() : nullptr;
+		cmd.textures[2] = texture_2 ? texture_2->batch_key() : nullptr;
+		cmd.textures[3] = texture_3 ? texture_3->batch_key() : nullptr;
+		cmd.blend = CTX->blend_func_stack.top();
+		cmd.instance_count = 1;
+		record_instances(commands, cmd, instance_data);
+		return {};
+	}
 
 	result draw(const draw_args& args)
 	{
@@ -1088,12 +3003,38 @@ namespace imr::sprite
 		}
 		auto& state = CTX->camera_stack.top();
 
+		if (state.culling)
+		{
+			const Itexture_info* texture = args.texture_info ? args.texture_info : CTX->white_texture_info.get();
+			float2 size = args.sprite_info ? args.sprite_info->size : texture->size();
+			float2 offset = args.sprite_info ? args.offset + args.sprite_info->offset : args.offset;
+			if (outside_rect(state.world_rect, args.position, bounding_radius(size, args.scale, offset)))
+			{
+				CTX->cull_stats.sprites++;
+				return {};
+			}
+		}
+
+		if (state.layered)
+		{
+			auto [ret, key] = layered_key(state, args);
+			IMRRESULT(ret);
+			state.layered_keys.push_back({ .key = key, .value = static_cast<uint32_t>(state.layered_sprites.size()) });
+			state.layered_sprites.push_back(args);
+			return {};
+		}
+
 		// try batch
 		if (state.try_batch)
 		{
-			auto is_same_material = [](const draw_args& lh, const draw_args& rh)
+			// pages of one texture array share a material
+			auto batch_key = [](const Itexture_info* texture) { return texture ? texture->batch_key() : nullptr; };
+			auto is_same_material = [&](const draw_args& lh, const draw_args& rh)
 			{
-				return lh.texture_info == rh.texture_info;
+				return batch_key(lh.texture_info) == batch_key(rh.texture_info)
+					&& batch_key(lh.texture_info_1) == batch_key(rh.texture_info_1)
+					&& batch_key(lh.texture_info_2) == batch_key(rh.texture_info_2)
+					&& batch_key(lh.texture_info_3) == batch_key(rh.texture_info_3);
 			};
 
 			if (state.batches.size() > 0 && is_same_material(args, state.batches.back()) == false)
@@ -1104,11 +3045,8 @@ namespace imr::sprite
 			return {};
 		}
 
-		auto sprite_program = std::dynamic_pointer_cast<program>(CTX->programs[SPRITE_PROGRAM_NAME]);
-		sprite_program->use();
-
 		const Itexture_info* texture = args.texture_info ? args.texture_info : CTX->white_texture_info.get();
-		float4 uv_rect = { 0, 1, 1, 0 };
+		float4 uv_rect = texture->uv_rect();
 		float2 offset = args.offset;
 		int2 size = {};
 
@@ -1120,29 +3058,39 @@ namespace imr::sprite
 			size = args.sprite_info->size;
 		}
 
+		if (state.commands)
+		{
+			return record_sprite(state.commands, texture, args.texture_info_1, args.texture_info_2, args.texture_info_3, args.position, args.scale, args.rotation, size, uv_rect, args.color, offset);
+		}
+
+		// the sprite program samples a 2d texture, array pages go through instancing
+		if (texture->is_array())
+		{
+			IMRRESULT(imr::instancing::begin({ .texture_info = texture, .texture_info_1 = args.texture_info_1, .texture_info_2 = args.texture_info_2, .texture_info_3 = args.texture_info_3 }));
+			imr::instancing::instance({ .sprite_info = args.sprite_info, .position = args.position, .scale = args.scale, .rotation = args.rotation, .color = args.color, .offset = args.offset });
+			return imr::instancing::end();
+		}
+
+		flush_mesh_batch();
+		auto* sprite_program = CTX->get_program(CTX->builtin_programs.sprite);
+		sprite_program->use();
+
 		{
-			glActiveTexture(GL_TEXTURE0);
+			CTX->gl_state.active_texture(0);
 			texture->bind();
-			bind_multi_textures(sprite_program.get(), args.texture_info_1, args.texture_info_2, args.texture_info_3);
+			bind_multi_textures(sprite_program, args.texture_info_1, args.texture_info_2, args.texture_info_3, texture->is_array());
 		}
 
 		{
-			union uniform_buffer
+			// per sprite data only, the matrices come from the camera block
+			struct uniform_buffer
 			{
-				float4 value[13] = {};
-				struct
-				{
-					glm::mat4 uProjectionMatrix;
-					glm::mat4 uViewMatrix;
-					float4 uTranslateScale;
-					float4 uSizeOffset;
-					float4 uColor;
-					float4 uUVRect;
-					float4 uRotationRev;
-				};
+				float4 uTranslateScale;
+				float4 uSizeOffset;
+				float4 uColor;
+				float4 uUVRect;
+				float4 uRotationRev;
 			} buf{};
-			buf.uProjectionMatrix = state.projection;
-			buf.uViewMatrix = state.view;
 			buf.uTranslateScale.xy = args.position;
 			buf.uTranslateScale.zw = args.scale;
 			buf.uSizeOffset.xy = size;
@@ -1151,13 +3099,14 @@ namespace imr::sprite
 			buf.uUVRect = uv_rect;
 			buf.uRotationRev.x = args.rotation * glm::pi<float>() / 180.0f;
 
-			glUniform4fv(sprite_program->get_uniform_location(0), sizeof(uniform_buffer) / sizeof(float4), (const GLfloat*)buf.value);
+			glUniform4fv(sprite_program->get_uniform_location(0), sizeof(uniform_buffer) / sizeof(float4), buf.uTranslateScale.value);
 		}
 		GL_ASSERT();
-		glBindVertexArray(CTX->quad_vao);
+		CTX->gl_state.bind_vertex_array(CTX->quad_vao);
 		GL_ASSERT();
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void*)0);
-		glBindVertexArray(0);
+		CTX->gl_state.counters.draw_calls++;
+		CTX->gl_state.counters.vertices += 4;
 
 		return {};
 	}
@@ -1178,16 +3127,25 @@ namespace imr::sprite
 			}
 			else
 			{
-				IMRRESULT(imr::instancing::begin({ .texture_info = state.batches.front().texture_info }));
+				// a run shares all four textures, so it draws like the single sprite path
+				auto& front = state.batches.front();
+				IMRRESULT(imr::instancing::begin({
+					.texture_info = front.texture_info,
+					.texture_info_1 = front.texture_info_1,
+					.texture_info_2 = front.texture_info_2,
+					.texture_info_3 = front.texture_info_3,
+				}));
 				for (auto& args : state.batches)
 				{
+					// every sprite samples its own page of the array
 					imr::instancing::instance({
 						.sprite_info = args.sprite_info,
+						.texture_info = args.texture_info,
 						.position = args.position,
 						.scale = args.scale,
 						.rotation = args.rotation,
 						.color = args.color,
-						.offset = {}
+						.offset = args.offset
 					});
 				}
 				imr::instancing::end();
@@ -1217,30 +3175,42 @@ namespace imr::sprite
 		}
 		auto& state = CTX->camera_stack.top();
 
-		auto sprite_program = std::dynamic_pointer_cast<program>(CTX->programs[SPRITE_PROGRAM_NAME]);
+		if (state.culling && outside_rect(state.world_rect, position, bounding_radius(tex_info->size(), scale, offset)))
+		{
+			CTX->cull_stats.sprites++;
+			return {};
+		}
+
+		float4 uv_rect = tex_info->uv_rect();
+		if (state.commands)
+		{
+			return record_sprite(state.commands, tex_info, nullptr, nullptr, nullptr, position, scale, rotation, tex_info->size(), uv_rect, color, offset);
+		}
+
+		if (tex_info->is_array())
+		{
+			IMRRESULT(imr::instancing::begin({ .texture_info = tex_info }));
+			imr::instancing::instance({ .position = position, .scale = scale, .rotation = rotation, .color = color, .offset = offset });
+			return imr::instancing::end();
+		}
+
+		flush_mesh_batch();
+		auto* sprite_program = CTX->get_program(CTX->builtin_programs.sprite);
 		sprite_program->use();
 
-		glActiveTexture(GL_TEXTURE0);
+		CTX->gl_state.active_texture(0);
 		tex_info->bind();
 
-		float4 uv_rect = { 0, 1, 1, 0 };
 		{
-			union uniform_buffer
+			// per sprite data only, the matrices come from the camera block
+			struct uniform_buffer
 			{
-				float4 value[13] = {};
-				struct
-				{
-					glm::mat4 uProjectionMatrix;
-					glm::mat4 uViewMatrix;
-					float4 uTranslateScale;
-					float4 uSizeOffset;
-					float4 uColor;
-					float4 uUVRect;
-					float4 uRotationRev;
-				};
+				float4 uTranslateScale;
+				float4 uSizeOffset;
+				float4 uColor;
+				float4 uUVRect;
+				float4 uRotationRev;
 			} buf{};
-			buf.uProjectionMatrix = state.projection;
-			buf.uViewMatrix = state.view;
 			buf.uTranslateScale.xy = position;
 			buf.uTranslateScale.zw = scale;
 			buf.uSizeOffset.xy = tex_info->size();
@@ -1249,13 +3219,14 @@ namespace imr::sprite
 			buf.uUVRect = uv_rect;
 			buf.uRotationRev.x = rotation * glm::pi<float>() / 180.0f;
 
-			glUniform4fv(sprite_program->get_uniform_location(0), sizeof(uniform_buffer) / sizeof(float4), (const GLfloat*)buf.value);
+			glUniform4fv(sprite_program->get_uniform_location(0), sizeof(uniform_buffer) / sizeof(float4), buf.uTranslateScale.value);
 		}
 		GL_ASSERT();
-		glBindVertexArray(CTX->quad_vao);
+		CTX->gl_state.bind_vertex_array(CTX->quad_vao);
 		GL_ASSERT();
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void*)0);
-		glBindVertexArray(0);
+		CTX->gl_state.counters.draw_calls++;
+		CTX->gl_state.counters.vertices += 4;
 
 		return {};
 	}
@@ -1263,11 +3234,142 @@ namespace imr::sprite
 
 namespace imr::instancing
 {
+	result flush_instances(instancing_state& state)
+	{
+		if (state.instance_count == 0)
+		{
+			return {};
+		}
+
+		program* current_program = {};
+		if (state.program != INVALID_PROGRAM_HANDLE)
+		{
+			current_program = CTX->get_program(state.program);
+		}
+		else if (state.compact || CTX->program_stack.empty())
+		{
+			current_program = instancing_program(state.texture_info, state.compact);
+		}
+		else
+		{
+			current_program = CTX->get_program(CTX->program_stack.top());
+		}
+
+		if (current_program == nullptr)
+		{
+			state.instance_count = 0;
+			return { .type = result_type::fail, .error_code = 2, .msg = "invalid program" };
+		}
+		// only the built-in array programs declare sampler2DArray, for the pages and their normal maps alike
+		if (state.texture_info->is_array() && current_program != instancing_program(state.texture_info, state.compact))
+		{
+			state.instance_count = 0;
+			return { .type = result_type::fail, .error_code = 3, .msg = "a pushed program can't sample a texture array" };
+		}
+		if (state.texture_info->is_array() && state.texture_info_1 && state.texture_info_1->is_array() == false)
+		{
+			state.instance_count = 0;
+			return { .type = result_type::fail, .error_code = 4, .msg = "the normal map of an array page has to be an array page" };
+		}
+
+		draw_command cmd = {};
+		cmd.type = draw_command::instancing;
+		cmd.program = current_program;
+		cmd.compact_instance = state.compact;
+		cmd.textures[0] = state.texture_info->batch_key();
+		cmd.textures[1] = state.texture_info_1 ? state.texture_info_1->batch_key() : nullptr;
+		cmd.textures[2] = state.texture_info_2 ? state.texture_info_2->batch_key() : nullptr;
+		cmd.textures[3] = state.texture_info_3 ? state.texture_info_3->batch_key() : nullptr;
+		cmd.blend = CTX->blend_func_stack.top();
+		cmd.instance_count = state.instance_count;
+		state.instance_count = 0;
+
+		if (auto* commands = current_command_list())
+		{
+			record_instances(commands, cmd, state.staging->data());
+			return {};
+		}
+		flush_mesh_batch();
+		return draw_instances(cmd, state.staging->data());
+	}
+
+	// grows the staging to hold instance_count instances, in chunks so single instances don't grow it one by one.
+	// it never grows past one batch, a full batch is drawn first
+	void reserve_staging(instancing_state& state, size_t instance_count)
+	{
+		const size_t STAGING_CHUNK = 4096;
+		if (state.staging->size() >= instance_count * state.format_count())
+		{
+			return;
+		}
+		size_t chunked = (instance_count + STAGING_CHUNK - 1) / STAGING_CHUNK * STAGING_CHUNK;
+		state.staging->resize(std::min<size_t>(chunked, instancing_state::MAX_INSTSANCE_COUNT) * state.format_count());
+	}
+
+	// an instance draws the whole begun texture unless it names a sprite or another page of the same array
+	result instance_source(const instance_args& args, const Itexture_info* texture, float2& size, float4& uv_rect, float2& offset, float& layer)
+	{
+		if (args.texture_info)
+		{
+			if (args.texture_info->batch_key() != texture->batch_key())
+			{
+				return { .type = result_type::fail, .error_code = 3, .msg = "texture isn't a page of the begun texture" };
+			}
+			size = args.texture_info->size();
+			uv_rect = args.texture_info->uv_rect();
+			layer = static_cast<float>(args.texture_info->layer());
+		}
+		if (args.sprite_info)
+		{
+			auto* sprite = args.sprite_info;
+			size = sprite->size;
+			uv_rect = sprite->uv_rect;
+			offset = offset + sprite->offset;
+			layer = sprite->layer;
+		}
+		return {};
+	}
+
+	// true when the instance lies outside the cull rect, it is counted as culled
+	bool cull_instance(const float2& position, const float2& scale, const float2& size, const float2& offset)
+	{
+		if (auto* rect = current_cull_rect(); rect && outside_rect(*rect, position, bounding_radius(size, scale, offset)))
+		{
+			CTX->cull_stats.instances++;
+			return true;
+		}
+		return false;
+	}
+
+	// callers cull first, instance_many and primitive::shape with their own checks
+	result stage_instance(instancing_state& state, const float2& position, const float2& scale, float rotation, const float2& size, const float4& uv_rect, const float4& color, const float2& offset, float layer)
+	{
+		if (state.instance_count >= instancing_state::MAX_INSTSANCE_COUNT)
+		{
+			IMRRESULT(flush_instances(state));
+		}
+		reserve_staging(state, state.instance_count + 1);
+		float* instance_data = state.staging->data() + state.instance_count * state.format_count();
+		if (state.compact)
+		{
+			write_compact_instance(instance_data, position, scale, rotation, size, uv_rect, color, offset, layer);
+		}
+		else
+		{
+			write_instance(instance_data, position, scale, rotation, size, uv_rect, color, offset, layer);
+		}
+		state.instance_count++;
+		return {};
+	}
+
 	result begin(const begin_args& args)
 	{
 		auto& state = CTX->instancing_stack.emplace();
 		state.begin = true;
+		state.compact = args.compact && CTX->program_stack.empty();
+		state.staging = CTX->get_instance_staging(CTX->instancing_stack.size() - 1);
 		state.texture_info = args.texture_info ? args.texture_info : CTX->white_texture_info.get();
+		state.layer = static_cast<float>(state.texture_info->layer());
 		state.texture_info_1 = args.texture_info_1;
 		state.texture_info_2 = args.texture_info_2;
 		state.texture_info_3 = args.texture_info_3;
@@ -1283,48 +3385,111 @@ namespace imr::instancing
 		auto& state = CTX->instancing_stack.top();
 		assert(state.texture_info);
 
-		int2 sprite_size = state.texture_info->size();
-		float4 uv_rect = { 0, 1, 1, 0 };
+		float2 sprite_size = state.texture_info->size();
+		float4 uv_rect = state.texture_info->uv_rect();
 		float2 offset = args.offset;
+		float layer = state.layer;
+		IMRRESULT(instance_source(args, state.texture_info, sprite_size, uv_rect, offset, layer));
+		if (cull_instance(args.position, args.scale, sprite_size, offset))
+		{
+			return {};
+		}
 
-		if (args.sprite_info)
+		return stage_instance(state, args.position, args.scale, args.rotation, sprite_size, uv_rect, args.color, offset, layer);
+	}
+
+	result instance_many(const instance_many_args& args)
+	{
+		if (CTX->instancing_stack.empty() || CTX->instancing_stack.top().begin == false)
 		{
-			auto* sprite = args.sprite_info;
-			sprite_size = sprite->size;
-			uv_rect = sprite->uv_rect;
-			offset = offset + sprite->offset;
+			return { .type = result_type::fail, .error_code = 1, .msg = "instancing not begun" };
 		}
+		auto& state = CTX->instancing_stack.top();
+		assert(state.texture_info);
 
+		const size_t count = args.positions.size();
+		auto valid_size = [count](size_t size) { return size == 0 || size >= count; };
+		if (valid_size(args.scales.size()) == false
+			|| valid_size(args.rotations.size()) == false
+			|| valid_size(args.colors.size()) == false
+			|| valid_size(args.sprite_indices.size()) == false)
 		{
-			float* instance_data = &instancing_state::SHARE_BUFFER[state.instance_count * instancing_state::INSTANCE_FORMAT_COUNT];
-			int idx = 0;
-			// translate, scale
-			instance_data[idx++] = args.position.x;
-			instance_data[idx++] = args.position.y;
-			instance_data[idx++] = args.scale.x;
-			instance_data[idx++] = args.scale.y;
-			// rotation, width, height
-			instance_data[idx++] = args.rotation * glm::pi<float>() / 180.0f;
-			instance_data[idx++] = static_cast<float>(sprite_size.x);
-			instance_data[idx++] = static_cast<float>(sprite_size.y);
-			instance_data[idx++] = 0;
-			// uv rect
-			instance_data[idx++] = uv_rect[0];
-			instance_data[idx++] = uv_rect[1];
-			instance_data[idx++] = uv_rect[2];
-			instance_data[idx++] = uv_rect[3];
-			// color
-			instance_data[idx++] = args.color.x;
-			instance_data[idx++] = args.color.y;
-			instance_data[idx++] = args.color.z;
-			instance_data[idx++] = args.color.w;
-			// offset rev
-			instance_data[idx++] = offset.x;
-			instance_data[idx++] = offset.y;
-			instance_data[idx++] = 0;
-			instance_data[idx++] = 0;
+			return { .type = result_type::fail, .error_code = 2, .msg = "span shorter than positions" };
+		}
+		if (args.sprite_indices.empty() == false && args.sprites.empty())
+		{
+			return { .type = result_type::fail, .error_code = 3, .msg = "sprite indices without sprites" };
+		}
+		// the packing and culling kernels index the sprite table unchecked
+		for (size_t i = 0; i < args.sprite_indices.size() && i < count; ++i)
+		{
+			if (args.sprite_indices[i] < 0 || static_cast<size_t>(args.sprite_indices[i]) >= args.sprites.size())
+			{
+				return { .type = result_type::fail, .error_code = 4, .msg = "sprite index out of range" };
+			}
+		}
+
+		const float2 texture_size = state.texture_info->size();
+		const float4 texture_uv = state.texture_info->uv_rect();
+
+		// with culling only the visible items are packed
+		const uint32_t* indices = {};
+		size_t total = count;
+		if (auto* rect = current_cull_rect())
+		{
+			auto& visible = CTX->visible_indices;
+			visible.resize(count);
+			total = cull_instances(visible.data(), args, count, texture_size, *rect);
+			CTX->cull_stats.instances += count - total;
+			indices = visible.data();
+		}
+
+		if (state.compact)
+		{
+			reserve_staging(state, state.instance_count + total);
+			for (size_t k = 0; k < total; ++k)
+			{
+				size_t i = indices ? indices[k] : k;
+				float2 size = texture_size;
+				float4 uv_rect = texture_uv;
+				float2 offset = {};
+				float layer = state.layer;
+				if (args.sprite_indices.empty() == false)
+				{
+					auto* sprite = args.sprites[args.sprite_indices[i]];
+					size = sprite->size;
+					uv_rect = sprite->uv_rect;
+					offset = sprite->offset;
+					layer = sprite->layer;
+				}
+				IMRRESULT(stage_instance(
+					state,
+					args.positions[i],
+					args.scales.empty() ? float2{ 1, 1 } : args.scales[i],
+					args.rotations.empty() ? 0.0f : args.rotations[i],
+					size,
+					uv_rect,
+					args.colors.empty() ? float4{ 1, 1, 1, 1 } : args.colors[i],
+					offset,
+					layer
+				));
+			}
+			return {};
+		}
+
+		size_t first = 0;
+		while (first < total)
+		{
+			if (state.instance_count >= instancing_state::MAX_INSTSANCE_COUNT)
+			{
+				IMRRESULT(flush_instances(state));
+			}
+			size_t chunk = std::min<size_t>(total - first, instancing_state::MAX_INSTSANCE_COUNT - state.instance_count);
+			reserve_staging(state, state.instance_count + chunk);
+			pack_instances(state.staging->data() + state.instance_count * instancing_state::INSTANCE_FORMAT_COUNT, args, indices, first, chunk, texture_size, texture_uv, state.layer);
+			state.instance_count += static_cast<int>(chunk);
+			first += chunk;
 		}
-		state.instance_count++;
 		return {};
 	}
 
@@ -1332,7 +3497,9 @@ namespace imr::instancing
 	{
 		auto& state = CTX->instancing_stack.emplace();
 		state.begin = true;
+		state.staging = CTX->get_instance_staging(CTX->instancing_stack.size() - 1);
 		state.texture_info = texture ? texture : CTX->white_texture_info.get();
+		state.layer = static_cast<float>(state.texture_info->layer());
 		state.texture_info_1 = texture_1;
 		state.texture_info_2 = texture_2;
 		state.texture_info_3 = texture_3;
@@ -1352,37 +3519,11 @@ namespace imr::instancing
 			return { .type = result_type::fail, .error_code = 2, .msg = "sprite info is null" };
 		}
 
+		if (cull_instance(position, scale, sprite_info->size, sprite_info->offset))
 		{
-			float* instance_data = &instancing_state::SHARE_BUFFER[state.instance_count * instancing_state::INSTANCE_FORMAT_COUNT];
-			int idx = 0;
-			// translate, scale
-			instance_data[idx++] = position.x;
-			instance_data[idx++] = position.y;
-			instance_data[idx++] = scale.x;
-			instance_data[idx++] = scale.y;
-			// rotation, width, height
-			instance_data[idx++] = rotation * glm::pi<float>() / 180.0f;
-			instance_data[idx++] = static_cast<float>(sprite_info->size.x);
-			instance_data[idx++] = static_cast<float>(sprite_info->size.y);
-			instance_data[idx++] = 0;
-			// uv rect
-			instance_data[idx++] = sprite_info->uv_rect[0];
-			instance_data[idx++] = sprite_info->uv_rect[1];
-			instance_data[idx++] = sprite_info->uv_rect[2];
-			instance_data[idx++] = sprite_info->uv_rect[3];
-			// color
-			instance_data[idx++] = color.x;
-			instance_data[idx++] = color.y;
-			instance_data[idx++] = color.z;
-			instance_data[idx++] = color.w;
-			// offset rev
-			instance_data[idx++] = sprite_info->offset.x;
-			instance_data[idx++] = sprite_info->offset.y;
-			instance_data[idx++] = 0;
-			instance_data[idx++] = 0;
+			return {};
 		}
-		state.instance_count++;
-		return {};
+		return stage_instance(state, position, scale, rotation, sprite_info->size, sprite_info->uv_rect, color, sprite_info->offset, sprite_info->layer);
 	}
 	result begin(Itexture_info* texture)
 	{
@@ -1392,7 +3533,9 @@ namespace imr::instancing
 		}
 		auto& state = CTX->instancing_stack.emplace();
 		state.begin = true;
+		state.staging = CTX->get_instance_staging(CTX->instancing_stack.size() - 1);
 		state.texture_info = texture;
+		state.layer = static_cast<float>(texture->layer());
 		return {};
 	}
 	result instance(const float2& sprite_pos, const float2& sprite_size, const float2& offset, const float2& position, const float2& scale, const float rotation, const float4& color)
@@ -1403,43 +3546,12 @@ namespace imr::instancing
 		}
 		auto& state = CTX->instancing_stack.top();
 
-		float4 uv_rect = {};
-		float2 frame_size = state.texture_info->size();
-		uv_rect.xy = sprite_pos / frame_size;
-		uv_rect.zw = (sprite_pos + sprite_size) / frame_size;
-		uv_rect.y = 1.0f - uv_rect.y;
-		uv_rect.w = 1.0f - uv_rect.w;
-		{
-			float* instance_data = &instancing_state::SHARE_BUFFER[state.instance_count * instancing_state::INSTANCE_FORMAT_COUNT];
-			int idx = 0;
-			// translate, scale
-			instance_data[idx++] = position.x;
-			instance_data[idx++] = position.y;
-			instance_data[idx++] = scale.x;
-			instance_data[idx++] = scale.y;
-			// rotation, width, height
-			instance_data[idx++] = rotation * glm::pi<float>() / 180.0f;
-			instance_data[idx++] = static_cast<float>(sprite_size.x);
-			instance_data[idx++] = static_cast<float>(sprite_size.y);
-			instance_data[idx++] = 0;
-			// uv rect
-			instance_data[idx++] = uv_rect[0];
-			instance_data[idx++] = uv_rect[1];
-			instance_data[idx++] = uv_rect[2];
-			instance_data[idx++] = uv_rect[3];
-			// color
-			instance_data[idx++] = color.x;
-			instance_data[idx++] = color.y;
-			instance_data[idx++] = color.z;
-			instance_data[idx++] = color.w;
-			// offset rev
-			instance_data[idx++] = offset.x;
-			instance_data[idx++] = offset.y;
-			instance_data[idx++] = 0;
-			instance_data[idx++] = 0;
+		if (cull_instance(position, scale, sprite_size, offset))
+		{
+			return {};
 		}
-		state.instance_count++;
-		return {};
+		const float4 uv_rect = texture_uv_rect(state.texture_info, sprite_pos, sprite_size);
+		return stage_instance(state, position, scale, rotation, sprite_size, uv_rect, color, offset, state.layer);
 	}
 	result end()
 	{
@@ -1449,89 +3561,118 @@ namespace imr::instancing
 		}
 		auto state = std::move(CTX->instancing_stack.top());
 		CTX->instancing_stack.pop();
-		if (state.instance_count == 0)
-		{
-			return {};
-		}
+		return flush_instances(state);
+	}
 
-		program* current_program = {};
-		if (CTX->program_stack.empty())
-		{
-			current_program = dynamic_cast<program*>(CTX->programs[INSTANCING_PROGRAM_NAME].get());
-		}
-		else
+	result sub_stream::instance(const instance_args& args)
+	{
+		if (_count >= _capacity)
 		{
-			current_program = dynamic_cast<program*>(CTX->programs[CTX->program_stack.top()].get());
+			return { .type = result_type::fail, .error_code = 1, .msg = "sub stream is full" };
 		}
 
-		if (current_program == nullptr)
+		float2 sprite_size = _texture_size;
+		float4 uv_rect = _uv_rect;
+		float2 offset = args.offset;
+		float layer = _layer;
+		IMRRESULT(instance_source(args, _texture, sprite_size, uv_rect, offset, layer));
+
+		if (_cull_rect && outside_rect(*_cull_rect, args.position, bounding_radius(sprite_size, args.scale, offset)))
 		{
-			return { .type = result_type::fail, .error_code = 2, .msg = "invalid program" };
+			_culled++;
+			return {};
 		}
-		else
+
+		if (_compact)
 		{
-			current_program->use();
+			write_compact_instance(_data + _count * instancing_state::COMPACT_INSTANCE_FORMAT_COUNT, args.position, args.scale, args.rotation, sprite_size, uv_rect, args.color, offset, layer);
 		}
-
-		// projection view matrix
+		else
 		{
-			auto& cam_state = CTX->camera_stack.top();
-			glUniformMatrix4fv(
-				current_program->get_uniform_location(0),
-				1,
-				GL_FALSE,
-				glm::value_ptr(cam_state.projection)
-			);
-			glUniformMatrix4fv(
-				current_program->get_uniform_location(1),
-				1,
-				GL_FALSE,
-				glm::value_ptr(cam_state.view)
-			);
+			write_instance(_data + _count * instancing_state::INSTANCE_FORMAT_COUNT, args.position, args.scale, args.rotation, sprite_size, uv_rect, args.color, offset, layer);
 		}
+		_count++;
+		return {};
+	}
 
-		// texture
+	result instance_parallel(size_t count, const std::function<void(sub_stream& stream, size_t first, size_t last)>& fill)
+	{
+		if (CTX->instancing_stack.empty() || CTX->instancing_stack.top().begin == false)
 		{
-			glUniform1i(current_program->get_uniform_location(TEXTURE_REG_0), 0);
-			assert(state.texture_info != nullptr);
-			glActiveTexture(GL_TEXTURE0);
-			state.texture_info->bind();
-			bind_multi_textures(current_program, state.texture_info_1, state.texture_info_2, state.texture_info_3);
+			return { .type = result_type::fail, .error_code = 1, .msg = "instancing not begun" };
 		}
+		auto& state = CTX->instancing_stack.top();
+		assert(state.texture_info);
 
-		glBindVertexArray(CTX->instancing_attrib_vao);
-		GL_ASSERT();
-
-		// bind instance buffer
-		auto instance_size = state.instance_count * instancing_state::INSTANCE_FORMAT_SIZE;
-		auto instance_buffer = CTX->get_array_buffer(instance_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
-		instance_buffer->bind();
-		instance_buffer->sub_data(0, instance_size, instancing_state::SHARE_BUFFER.data());
-
-#define VERTEX_ATRIB_POINTER(reg, offset) \
-{ \
-	auto loc = current_program->get_attrib_location(reg); \
-	glEnableVertexAttribArray(loc); \
-	glVertexAttribPointer(loc, 4, GL_FLOAT, false, instancing_state::INSTANCE_FORMAT_SIZE, (void*)(offset * sizeof(float))); \
-	glVertexAttribDivisor(loc, 1); \
-}
+		// small slices cost more in wake ups than they save
+		const size_t MIN_SLICE_SIZE = 4096;
+		auto* workers = CTX->get_workers();
+		const int format_count = state.format_count();
 
-		VERTEX_ATRIB_POINTER(1, 0);
-		VERTEX_ATRIB_POINTER(2, 4);
-		VERTEX_ATRIB_POINTER(3, 8);
-		VERTEX_ATRIB_POINTER(4, 12);
-		VERTEX_ATRIB_POINTER(5, 16);
-		GL_ASSERT();
+		size_t first = 0;
+		while (first < count)
+		{
+			if (state.instance_count >= instancing_state::MAX_INSTSANCE_COUNT)
+			{
+				IMRRESULT(flush_instances(state));
+			}
+			const size_t round = std::min<size_t>(count - first, instancing_state::MAX_INSTSANCE_COUNT - state.instance_count);
+			const size_t slice_count = std::max<size_t>(1, std::min<size_t>(workers->size() + 1, round / MIN_SLICE_SIZE));
+			const size_t slice_size = (round + slice_count - 1) / slice_count;
+
+			// reserve one instance per item, then every slice writes into its own range
+			reserve_staging(state, state.instance_count + round);
+			float* base = state.staging->data() + state.instance_count * format_count;
+			std::vector<sub_stream> streams(slice_count);
+			for (size_t i = 0; i < slice_count; ++i)
+			{
+				auto& stream = streams[i];
+				size_t slice_first = std::min(round, i * slice_size);
+				stream._data = base + slice_first * format_count;
+				stream._capacity = static_cast<int>(std::min(round, slice_first + slice_size) - slice_first);
+				stream._compact = state.compact;
+				stream._texture = state.texture_info;
+				stream._texture_size = state.texture_info->size();
+				stream._uv_rect = state.texture_info->uv_rect();
+				stream._layer = state.layer;
+				stream._cull_rect = current_cull_rect();
+			}
 
-		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0, state.instance_count);
-		GL_ASSERT();
+			auto job = [&](size_t i)
+			{
+				size_t slice_first = first + i * slice_size;
+				fill(streams[i], slice_first, slice_first + streams[i]._capacity);
+			};
+			if (slice_count == 1)
+			{
+				job(0);
+			}
+			else
+			{
+				workers->parallel_for(slice_count, job);
+			}
 
-		// restore
-		instance_buffer->unbind();
-		CTX->release_array_buffer(std::move(instance_buffer));
-		glBindVertexArray(0);
+			// join, slices move down over the unused tail of the previous one
+			float* dst = base;
+			for (auto& stream : streams)
+			{
+				if (dst != stream._data && stream._count > 0)
+				{
+					memmove(dst, stream._data, stream._count * format_count * sizeof(float));
+				}
+				dst += stream._count * format_count;
+				state.instance_count += stream._count;
+				CTX->cull_stats.instances += stream._culled;
+			}
+			first += round;
+		}
 		return {};
 	}
+
+	size_t staging_memory_size()
+	{
+		return CTX->instance_staging_bytes();
+	}
 }
 
 namespace imr::blend
@@ -1551,10 +3692,64 @@ namespace imr::blend
 
 namespace imr::mesh
 {
+	// world space meshes of the built-in mesh layout only, where position is the first two floats of a vertex.
+	// other programs may lay their vertices out in any way and are never culled
+	bool cull_mesh(const float* vertices, int v_stride, size_t v_cnt, bool mesh_layout)
+	{
+		auto* rect = current_cull_rect();
+		if (rect == nullptr || mesh_layout == false || v_stride < 2 || v_cnt == 0)
+		{
+			return false;
+		}
+		float4 bounds = { vertices[0], vertices[1], vertices[0], vertices[1] };
+		for (size_t i = v_stride; i + 1 < v_cnt; i += v_stride)
+		{
+			bounds.x = std::min(bounds.x, vertices[i]);
+			bounds.y = std::min(bounds.y, vertices[i + 1]);
+			bounds.z = std::max(bounds.z, vertices[i]);
+			bounds.w = std::max(bounds.w, vertices[i + 1]);
+		}
+		if (bounds.z < rect->x || bounds.x > rect->z || bounds.w < rect->y || bounds.y > rect->w)
+		{
+			CTX->cull_stats.meshes++;
+			return true;
+		}
+		return false;
+	}
+
 	result draw(const draw_args& args)
 	{
+		// an immediate camera merges draws while program, textures and blend repeat, the batch is drawn by the
+		// next draw of another kind, a state change or camera::end. deferred cameras merge in record_mesh already
+		auto* batch = CTX->camera_stack.empty() ? nullptr : CTX->camera_stack.top().mesh_batch;
+		if (batch)
+		{
+			if (args.texture_info == nullptr)
+			{
+				return { .type = fail, .error_code = 1, .msg = "no such texture or frame" };
+			}
+			const int stride = sizeof(imr::mesh::vertex) / sizeof(float);
+			const float* vertices = (const float*)args.vertices.data();
+			if (args.indices.empty() || cull_mesh(vertices, stride, args.vertices.size() * stride, true))
+			{
+				return {};
+			}
+			static const vert_attrib_pointer attrib_pointers[] = { { .location = 0, .count = 4, .stride = stride, .offset = 0 }, { .location = 1, .count = 4, .stride = stride, .offset = 4 } };
+			draw_command cmd = {};
+			cmd.type = draw_command::mesh;
+			cmd.program = CTX->get_program(CTX->builtin_programs.mesh);
+			cmd.textures[0] = args.texture_info;
+			cmd.blend = CTX->blend_func_stack.top();
+			cmd.vertex_stride = stride;
+			cmd.vertex_count = static_cast<int>(args.vertices.size());
+			cmd.index_count = static_cast<int>(args.indices.size());
+			cmd.attrib_count = 2;
+			record_mesh(batch, cmd, vertices, args.indices.data(), attrib_pointers, nullptr, nullptr);
+			return {};
+		}
+
 		imr::mesh::begin();
-		imr::mesh::use_program(imr::MESH_PROGRAM_NAME);
+		imr::mesh::use_program(CTX->builtin_programs.mesh);
 		int stride = sizeof(imr::mesh::vertex) / sizeof(float);
 		imr::mesh::push_meshes((const float*)args.vertices.data(), stride, static_cast<int>(args.vertices.size()) * stride, args.indices.data(), static_cast<int>(args.indices.size()));
 		imr::mesh::set_texture(0, args.texture_info);
@@ -1565,22 +3760,33 @@ namespace imr::mesh
 
 	result begin()
 	{
+		auto depth = CTX->mesh_stack.size();
 		auto& state = CTX->mesh_stack.emplace();
 		state.begin = true;
+		if (CTX->mesh_levels.size() <= depth)
+		{
+			CTX->mesh_levels.emplace_back();
+		}
+		state.buffers = &CTX->mesh_levels[depth];
 		return {};
 	}
 	result use_program(const std::string& name)
+	{
+		return use_program(get_program_handle(name));
+	}
+	result use_program(program_handle handle)
 	{
 		if (CTX->mesh_stack.empty())
 		{
 			return { .type = fail, .error_code = 1, .msg = "not mesh begun" };
 		}
 		auto& state = CTX->mesh_stack.top();
-		if (CTX->programs.find(name) == CTX->programs.end())
+		auto* prg = CTX->get_program(handle);
+		if (prg == nullptr)
 		{
 			return { .type = fail, .error_code = 2, .msg = "no such program" };
 		}
-		state.program = dynamic_cast<imr::program*>(CTX->programs[name].get());
+		state.program = prg;
 		state.program->use();
 
 		return {};
@@ -1595,27 +3801,39 @@ namespace imr::mesh
 		state.use_project_view_matrix = val;
 		return {};
 	}
-	result push_meshes(const float* vertices, int v_stride, size_t v_cnt, const unsigned short* indices, size_t i_cnt)
+	template <typename T>
+	result push_meshes_impl(const float* vertices, int v_stride, size_t v_cnt, const T* indices, size_t i_cnt)
 	{
 		if (CTX->mesh_stack.empty())
 		{
 			return { .type = fail, .error_code = 1, .msg = "not mesh begun" };
 		}
 		auto& state = CTX->mesh_stack.top();
+		const bool mesh_layout = state.use_project_view_matrix && state.program && state.program == CTX->get_program(CTX->builtin_programs.mesh);
+		if (cull_mesh(vertices, v_stride, v_cnt, mesh_layout))
+		{
+			return {};
+		}
 
-		auto prev_verts_cnt = static_cast<unsigned short>(state.vertices.size() / v_stride);
-		auto prev_indices_cnt = state.indices.size();
-		state.vertices.insert(state.vertices.end(), vertices, vertices + v_cnt);
-		state.indices.insert(state.indices.end(), indices, indices + i_cnt);
-		if (prev_verts_cnt > 0)
+		state.vertex_stride = v_stride;
+		auto& buffers = *state.buffers;
+		auto prev_verts_cnt = static_cast<uint32_t>(buffers.vertices.size() / v_stride);
+		buffers.vertices.insert(buffers.vertices.end(), vertices, vertices + v_cnt);
+		buffers.indices.reserve(buffers.indices.size() + i_cnt);
+		for (size_t i = 0; i < i_cnt; ++i)
 		{
-			for (auto i = prev_indices_cnt; i < state.indices.size(); ++i)
-			{
-				state.indices[i] += prev_verts_cnt;
-			}
+			buffers.indices.push_back(indices[i] + prev_verts_cnt);
 		}
 		return {};
 	}
+	result push_meshes(const float* vertices, int v_stride, size_t v_cnt, const unsigned short* indices, size_t i_cnt)
+	{
+		return push_meshes_impl(vertices, v_stride, v_cnt, indices, i_cnt);
+	}
+	result push_meshes(const float* vertices, int v_stride, size_t v_cnt, const uint32_t* indices, size_t i_cnt)
+	{
+		return push_meshes_impl(vertices, v_stride, v_cnt, indices, i_cnt);
+	}
 	result set_uniform_mat4(int location, const float* data, int length)
 	{
 		if (CTX->mesh_stack.empty())
@@ -1623,6 +3841,16 @@ namespace imr::mesh
 			return { .type = fail, .error_code = 1, .msg = "not mesh begun" };
 		}
 		auto& state = CTX->mesh_stack.top();
+		if (current_command_list())
+		{
+			auto& item = state.uniforms.emplace_back();
+			item.type = uniform_value::mat4;
+			item.location = location;
+			item.length = length;
+			item.offset = static_cast<int>(state.uniform_data.size());
+			state.uniform_data.insert(state.uniform_data.end(), data, data + length * 16);
+			return {};
+		}
 		glUniformMatrix4fv(state.program->get_uniform_location(location), length, GL_FALSE, data);
 		GL_ASSERT();
 		return {};
@@ -1634,6 +3862,16 @@ namespace imr::mesh
 			return { .type = fail, .error_code = 1, .msg = "not mesh begun" };
 		}
 		auto& state = CTX->mesh_stack.top();
+		if (current_command_list())
+		{
+			auto& item = state.uniforms.emplace_back();
+			item.type = uniform_value::vec4;
+			item.location = location;
+			item.length = length;
+			item.offset = static_cast<int>(state.uniform_data.size());
+			state.uniform_data.insert(state.uniform_data.end(), data, data + length * 4);
+			return {};
+		}
 		glUniform4fv(state.program->get_uniform_location(location), length, data);
 		GL_ASSERT();
 		return {};
@@ -1671,124 +3909,401 @@ namespace imr::mesh
 			return { .type = fail, .error_code = 1, .msg = "not mesh begun" };
 		}
 		auto& state = CTX->mesh_stack.top();
-		auto& cam_state = CTX->camera_stack.top();
-
-		GL_ASSERT();
-
-		static const int tex_idx[6] = {
-			GL_TEXTURE0,
-			GL_TEXTURE1,
-			GL_TEXTURE2,
-			GL_TEXTURE3,
-			GL_TEXTURE4,
-			GL_TEXTURE5
-		};
 
+		draw_command cmd = {};
+		cmd.type = draw_command::mesh;
+		cmd.program = state.program;
 		for (auto& p : state.textures)
 		{
-			if (p.second)
-			{
-				glUniform1i(state.program->get_uniform_location(texture_regs[p.first]), p.first);
-				glActiveTexture(tex_idx[p.first]);
-				p.second->bind();
-			}
-			else
+			if (cmd.program == nullptr || p.second == nullptr || p.first < 0 || p.first >= draw_command::MAX_TEXTURE_COUNT)
 			{
+				state.buffers->vertices.clear();
+				state.buffers->indices.clear();
+				CTX->mesh_stack.pop();
 				return { .type = fail, .error_code = 1, .msg = "no such texture or frame" };
 			}
+			cmd.textures[p.first] = p.second;
 		}
+		cmd.blend = CTX->blend_func_stack.top();
+		cmd.use_project_view_matrix = state.use_project_view_matrix;
+		cmd.vertex_stride = state.vertex_stride;
+		auto& buffers = *state.buffers;
+		cmd.vertex_count = state.vertex_stride > 0 ? static_cast<int>(buffers.vertices.size()) / state.vertex_stride : 0;
+		cmd.index_count = static_cast<int>(buffers.indices.size());
+		cmd.attrib_count = static_cast<int>(state.vert_attrib_pointers.size());
+		cmd.uniform_count = static_cast<int>(state.uniforms.size());
 
-		if (state.use_project_view_matrix)
+		result ret = {};
+		if (auto* commands = current_command_list())
 		{
-			union uniform_buffer
-			{
-				float4 value[8] = {};
-				struct
-				{
-					glm::mat4 uProjectionMatrix;
-					glm::mat4 uViewMatrix;
-				};
-			} buf{};
-			buf.uProjectionMatrix = cam_state.projection;
-			buf.uViewMatrix = cam_state.view;
-			glUniformMatrix4fv(state.program->get_uniform_location(0), sizeof(uniform_buffer) / sizeof(glm::mat4), GL_FALSE, (const GLfloat*)buf.value);
+			record_mesh(commands, cmd, buffers.vertices.data(), buffers.indices.data(), state.vert_attrib_pointers.data(), state.uniforms.data(), state.uniform_data.data());
 		}
-
-		GL_ASSERT();
-
-		// vao   glVertexAttribPointer  ߻
-		glBindVertexArray(CTX->temp_vao);
-
-		const int vertices_size = (int)state.vertices.size() * sizeof(float);
-		auto quad_vbo = CTX->get_array_buffer(vertices_size, GL_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
-		quad_vbo->bind();
-		quad_vbo->sub_data(0, vertices_size, state.vertices.data());
-		for (auto& p : state.vert_attrib_pointers)
+		else
 		{
-			glVertexAttribPointer(state.program->get_attrib_location(p.location), p.count, GL_FLOAT, GL_FALSE, p.stride * sizeof(float), (void*)(p.offset * sizeof(float)));
-			glEnableVertexAttribArray(state.program->get_attrib_location(p.location));
+			flush_mesh_batch();
+			ret = draw_mesh(cmd, buffers.vertices.data(), buffers.indices.data(), state.vert_attrib_pointers.data(), nullptr, nullptr);
 		}
 
-		const int indices_size = (int)state.indices.size() * sizeof(unsigned short);
-		auto indices_vbo = CTX->get_array_buffer(indices_size, GL_ELEMENT_ARRAY_BUFFER, GL_DYNAMIC_DRAW);
-		indices_vbo->bind();
-		indices_vbo->sub_data(0, indices_size, state.indices.data());
-
-		glDrawElements(GL_TRIANGLES, (GLsizei)state.indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-		GL_ASSERT();
-
-		CTX->release_array_buffer(std::move(quad_vbo));
-		CTX->release_array_buffer(std::move(indices_vbo));
-
-		state.vertices.clear();
-		state.indices.clear();
+		buffers.vertices.clear();
+		buffers.indices.clear();
 		CTX->mesh_stack.pop();
-		return {};
+		return ret;
 	}
 }
 
 namespace imr::primitive
 {
+	// the sdf program belongs to the primitive's own instancing level, so instancing, text or sprites drawn
+	// between begin and end keep their programs
 	result begin()
 	{
-		return imr::instancing::begin(CTX->white_texture_info.get());
+		IMRRESULT(imr::instancing::begin(CTX->white_texture_info.get()));
+		CTX->instancing_stack.top().program = CTX->builtin_programs.primitive;
+		return {};
+	}
+
+	namespace
+	{
+		bool begun()
+		{
+			return CTX->instancing_stack.empty() == false && CTX->instancing_stack.top().begin && CTX->instancing_stack.top().program == CTX->builtin_programs.primitive;
+		}
+	}
+
+	// one instance of the primitive program. size is the outer box including the stroke, offset the pivot inside it
+	result shape(const float2& position, const float2& size, float rotation, const float2& offset, float corner_radius, float thickness, const float4& color)
+	{
+		if (begun() == false)
+		{
+			return { .type = result_type::fail, .error_code = 1, .msg = "primitive not begun" };
+		}
+		if (auto* rect = current_cull_rect(); rect && outside_rect(*rect, position, bounding_radius(size, { 1, 1 }, offset)))
+		{
+			CTX->cull_stats.primitives++;
+			return {};
+		}
+		return imr::instancing::stage_instance(CTX->instancing_stack.top(), position, { 1, 1 }, rotation, size, { corner_radius, thickness, 0, 0 }, color, offset, 0);
 	}
 
 	result line(const line_args& args)
 	{
 		float2 dir = args.to - args.from;
 		float length = imr::length(dir);
-		float rotation = std::atan2f(dir.y, dir.x) * 180.0f / glm::pi<float>();
-		return imr::instancing::instance({
-			.position = args.from,
-			.scale = {length, args.thickness},
-			.rotation = rotation,
-			.color = args.color,
-			.offset = {0, 0.5},
-			});
+		float rotation = std::atan2(dir.y, dir.x) * 180.0f / glm::pi<float>();
+		return shape(args.from, { length, args.thickness }, rotation, { 0, 0.5f }, 0, 0, args.color);
 	}
 
 	result circle(const circle_args& args)
 	{
-		auto from = float2{ args.radius, 0 };
-		const auto angle_to_rad = glm::pi<float>() / 180.0f;
-		const int step_angle = 360 / args.segment;
-		for (int i = 0; i < args.segment; ++i)
-		{
-			auto to = from.rotate(step_angle * angle_to_rad);
-			line({
-				.from = from + args.center,
-				.to = to + args.center,
-				.thickness = args.thickness,
-				.color = args.color
-			});
-			from = to;
+		float thickness = args.filled ? 0 : args.thickness;
+		float diameter = args.radius * 2.0f + thickness;
+		return shape(args.center, { diameter, diameter }, 0, { 0.5f, 0.5f }, args.radius, thickness, args.color);
+	}
+
+	result rect(const rect_args& args)
+	{
+		float thickness = args.filled ? 0 : args.thickness;
+		float corner_radius = std::clamp(args.corner_radius, 0.0f, std::min(args.size.x, args.size.y) * 0.5f);
+		return shape(args.center, args.size + float2{ thickness, thickness }, args.rotation, { 0.5f, 0.5f }, corner_radius, thickness, args.color);
+	}
+
+	result capsule(const capsule_args& args)
+	{
+		float thickness = args.filled ? 0 : args.thickness;
+		float2 dir = args.to - args.from;
+		float length = imr::length(dir);
+		float rotation = std::atan2(dir.y, dir.x) * 180.0f / glm::pi<float>();
+		float2 size = { length + args.radius * 2.0f + thickness, args.radius * 2.0f + thickness };
+		return shape((args.from + args.to) * 0.5f, size, rotation, { 0.5f, 0.5f }, args.radius, thickness, args.color);
+	}
+
+	// shapes with the same points and style hash alike
+	uint64_t shape_hash(std::span<const float2> points, std::initializer_list<float> style)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](float value)
+		{
+			const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+			for (size_t i = 0; i < sizeof(value); ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+		for (auto& p : points)
+		{
+			add(p.x);
+			add(p.y);
 		}
-		return {};
+		for (auto value : style)
+		{
+			add(value);
+		}
+		return hash;
+	}
+
+	// the cached tessellation of points and style, built on a miss or when a hash collides.
+	// degenerate or oversized shapes stay cached as empty meshes
+	template <typename Build>
+	imr::mesh::draw_args& cached_shape(std::span<const float2> points, std::initializer_list<float> style, Build& build)
+	{
+		auto& shapes = CTX->shape_cache;
+		auto& index = CTX->shape_cache_index;
+		const uint64_t key = shape_hash(points, style);
+		auto same = [&](const shape_cache_entry& entry)
+		{
+			auto same_point = [](const float2& a, const float2& b) { return a.x == b.x && a.y == b.y; };
+			return std::ranges::equal(entry.points, points, same_point) && std::ranges::equal(entry.style, style);
+		};
+
+		auto found = index.find(key);
+		if (found != index.end())
+		{
+			auto entry = found->second;
+			shapes.splice(shapes.begin(), shapes, entry);
+			if (same(*entry) == false)
+			{
+				entry->points.assign(points.begin(), points.end());
+				entry->style.assign(style.begin(), style.end());
+				entry->mesh.vertices.clear();
+				entry->mesh.indices.clear();
+				build(entry->mesh);
+			}
+			return entry->mesh;
+		}
+
+		if (shapes.size() >= context::MAX_SHAPE_CACHE)
+		{
+			index.erase(shapes.back().key);
+			shapes.pop_back();
+		}
+		auto& entry = shapes.emplace_front(shape_cache_entry{
+			.key = key,
+			.points = { points.begin(), points.end() },
+			.style = style,
+		});
+		index.emplace(key, shapes.begin());
+		build(entry.mesh);
+		return entry.mesh;
+	}
+
+	// instances staged so far are drawn first to keep the order, then the mesh merges with neighbouring shapes
+	template <typename Build>
+	result draw_tessellated(bool cache, std::span<const float2> points, std::initializer_list<float> style, Build build)
+	{
+		if (begun() == false)
+		{
+			return { .type = result_type::fail, .error_code = 1, .msg = "primitive not begun" };
+		}
+		imr::mesh::draw_args* args = &CTX->shape_scratch;
+		if (cache)
+		{
+			args = &cached_shape(points, style, build);
+		}
+		else
+		{
+			args->vertices.clear();
+			args->indices.clear();
+			build(*args);
+		}
+		if (args->indices.empty())
+		{
+			return {};
+		}
+		args->texture_info = CTX->white_texture_info.get();
+		IMRRESULT(imr::instancing::flush_instances(CTX->instancing_stack.top()));
+		return imr::mesh::draw(*args);
+	}
+
+	result polygon(const polygon_args& args)
+	{
+		return draw_tessellated(args.cache, args.points, { args.filled ? 1.0f : 0.0f, args.thickness, static_cast<float>(args.join), args.color.x, args.color.y, args.color.z, args.color.w }, [&](imr::mesh::draw_args& out)
+		{
+			return args.filled
+				? imr::tessellate::fill(args.points, args.color, out)
+				: imr::tessellate::stroke(args.points, true, args.thickness, args.join, args.color, out);
+		});
+	}
+
+	result polyline(const polyline_args& args)
+	{
+		return draw_tessellated(args.cache, args.points, { args.closed ? 3.0f : 2.0f, args.thickness, static_cast<float>(args.join), args.color.x, args.color.y, args.color.z, args.color.w }, [&](imr::mesh::draw_args& out)
+		{
+			return imr::tessellate::stroke(args.points, args.closed, args.thickness, args.join, args.color, out);
+		});
+	}
+
+	void clear_shape_cache()
+	{
+		CTX->shape_cache_index.clear();
+		CTX->shape_cache.clear();
 	}
 
 	result end()
 	{
+		if (begun() == false)
+		{
+			return { .type = result_type::fail, .error_code = 1, .msg = "primitive not begun" };
+		}
 		return imr::instancing::end();
 	}
+}
+
+namespace imr::layer_cache
+{
+	namespace
+	{
+		bool contains(const float4& outer, const float4& inner)
+		{
+			return inner.x >= outer.x && inner.y >= outer.y && inner.z <= outer.z && inner.w <= outer.w;
+		}
+
+		bool same_units(const float2& lh, const float2& rh)
+		{
+			return std::abs(lh.x - rh.x) <= lh.x * 1e-4f && std::abs(lh.y - rh.y) <= lh.y * 1e-4f;
+		}
+
+		// texels hold premultiplied color and coverage alpha from the recording blend, composited with one, 1 - alpha
+		result draw_cached(context::layer_cache_entry& entry)
+		{
+			const float2 center = { (entry.world_rect.x + entry.world_rect.z) / 2.0f, (entry.world_rect.y + entry.world_rect.w) / 2.0f };
+			push_blend_func({ .src = GL_ONE, .dst = GL_ONE_MINUS_SRC_ALPHA });
+			auto ret = imr::sprite::draw_single(&entry.texture, center, entry.texel, 0, { 1, 1, 1, 1 }, { 0.5f, 0.5f });
+			pop_blend_func();
+			return ret;
+		}
+	}
+
+	std::tuple<result, bool> begin(const begin_args& args)
+	{
+		auto* ctx = CTX;
+		if (ctx->layer_cache_current)
+		{
+			return { {.type = fail, .error_code = 1, .msg = "layer_cache::end not called"}, false };
+		}
+		if (ctx->camera_stack.empty() || ctx->camera_stack.top().begin == false)
+		{
+			return { {.type = fail, .error_code = 2, .msg = "no camera stack"}, false };
+		}
+		if (args.name.empty())
+		{
+			return { {.type = fail, .error_code = 3, .msg = "empty layer cache name"}, false };
+		}
+
+		const auto& state = ctx->camera_stack.top();
+		const auto transform = imr::camera::screen_to_world_transform(state);
+		const float2 units = { transform.x.length(), transform.y.length() };
+		const float4 view_rect = state.world_rect;
+		const bool culling = state.culling;
+		const bool fixed_region = args.world_rect.z > args.world_rect.x && args.world_rect.w > args.world_rect.y;
+
+		auto& entry = ctx->layer_caches[std::string(args.name)];
+		ctx->layer_cache_current = &entry;
+		if (entry.valid && entry.fixed_region == fixed_region && same_units(entry.camera_units, units) &&
+			contains(entry.world_rect, fixed_region ? args.world_rect : view_rect))
+		{
+			auto ret = draw_cached(entry);
+			if (failed(ret))
+			{
+				ctx->layer_cache_current = {};
+			}
+			return { ret, false };
+		}
+
+		float4 region = fixed_region ? args.world_rect
+			: float4(view_rect.x - args.margin, view_rect.y - args.margin, view_rect.z + args.margin, view_rect.w + args.margin);
+		// one texel per screen pixel, lower when the region doesn't fit a texture
+		GLint max_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		float2 texel = units;
+		texel.x = std::max(texel.x, (region.z - region.x) / static_cast<float>(max_size - 2));
+		texel.y = std::max(texel.y, (region.w - region.y) / static_cast<float>(max_size - 2));
+		// snapped to the texel grid with an even size, so the recording camera sits on a whole texel and
+		// the cached quad lands on the same pixels the layer would have
+		region.x = std::floor(region.x / texel.x) * texel.x;
+		region.y = std::floor(region.y / texel.y) * texel.y;
+		int width = static_cast<int>(std::ceil((region.z - region.x) / texel.x));
+		int height = static_cast<int>(std::ceil((region.w - region.y) / texel.y));
+		width = std::max(2, width + (width & 1));
+		height = std::max(2, height + (height & 1));
+		region.z = region.x + width * texel.x;
+		region.w = region.y + height * texel.y;
+
+		if (entry.target == nullptr || entry.target->width() != width || entry.target->height() != height)
+		{
+			entry.texture = frame_buffer_texture_info(nullptr);
+			entry.target = acquire_render_target({ .width = width, .height = height });
+			entry.texture = frame_buffer_texture_info(entry.target);
+		}
+		entry.world_rect = region;
+		entry.texel = texel;
+		entry.camera_units = units;
+		entry.fixed_region = fixed_region;
+		entry.valid = false;
+
+		auto ret = imr::camera::begin({ .frame_buffer = entry.target.get(), .culling = culling });
+		if (failed(ret))
+		{
+			ctx->layer_cache_current = {};
+			return { ret, false };
+		}
+		imr::camera::clear({ 0, 0, 0, 0 });
+		imr::camera::camera({ .position = { (region.x + region.z) / 2.0f / texel.x, (region.y + region.w) / 2.0f / texel.y }, .scale = texel });
+		// alpha accumulates as coverage so the texels stay premultiplied, a plain alpha blend would store a*a
+		push_blend_func({ .src = GL_SRC_ALPHA, .dst = GL_ONE_MINUS_SRC_ALPHA, .separate_alpha = true, .src_alpha = GL_ONE, .dst_alpha = GL_ONE_MINUS_SRC_ALPHA });
+		ctx->layer_cache_recording = true;
+		return { result{}, true };
+	}
+
+	result end()
+	{
+		auto* ctx = CTX;
+		auto* entry = ctx->layer_cache_current;
+		if (entry == nullptr)
+		{
+			return { .type = fail, .error_code = 1, .msg = "layer_cache::begin not called" };
+		}
+		ctx->layer_cache_current = {};
+		if (ctx->layer_cache_recording == false)
+		{
+			return {};
+		}
+		ctx->layer_cache_recording = false;
+		pop_blend_func();
+		IMRRESULT(imr::camera::end());
+		entry->valid = true;
+		return draw_cached(*entry);
+	}
+
+	void invalidate(std::string_view name)
+	{
+		auto it = CTX->layer_caches.find(std::string(name));
+		if (it != CTX->layer_caches.end())
+		{
+			it->second.valid = false;
+		}
+	}
+
+	void invalidate_all()
+	{
+		for (auto& [name, entry] : CTX->layer_caches)
+		{
+			entry.valid = false;
+		}
+	}
+
+	void release(std::string_view name)
+	{
+		auto it = CTX->layer_caches.find(std::string(name));
+		// the layer between begin and end keeps its entry
+		if (it != CTX->layer_caches.end() && &it->second != CTX->layer_cache_current)
+		{
+			CTX->layer_caches.erase(it);
+		}
+	}
+
+	void release_all()
+	{
+		auto* current = CTX->layer_cache_current;
+		std::erase_if(CTX->layer_caches, [current](const auto& item) { return &item.second != current; });
+	}
 }
\ No newline at end of file
@@ -2,8 +2,16 @@
 
 #ifdef _WIN32
 #include <glad/glad.h>
+// GL_ARB_get_program_binary, glad is generated for gl 3.3 core only
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
 #else
 #include <GLES3/gl3.h>
+// GL_EXT_disjoint_timer_query
+#include <GLES2/gl2ext.h>
 #endif
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -13,9 +21,18 @@
 #include <optional>
 #include <stack>
 #include <map>
+#include <array>
+#include <deque>
+#include <list>
+#include <algorithm>
 #include <vector>
+#include <cstring>
+#include <chrono>
 
 #include "imr_core.h"
+#include "thread_pool.h"
+#include "radix_sort.h"
+#include "ktx.h"
 #include "imr_spine.h"
 #include "imr_text.h"
 #include "imr_scene.h"
@@ -40,22 +57,288 @@ while ((err = glGetError()) != GL_NO_ERROR) \
 
 namespace imr
 {
-	inline static int TEXTURE_REG_0 = 100;
-	inline static int TEXTURE_REG_1 = 101;
-	inline static int TEXTURE_REG_2 = 102;
-	inline static int TEXTURE_REG_3 = 103;
-	inline static int TIME_REG = 110;
+	inline constexpr int TEXTURE_REG_0 = 100;
+	inline constexpr int TEXTURE_REG_1 = 101;
+	inline constexpr int TEXTURE_REG_2 = 102;
+	inline constexpr int TEXTURE_REG_3 = 103;
+	inline constexpr int TEXTURE_REG_4 = 104;
+	inline constexpr int TEXTURE_REG_5 = 105;
+	inline constexpr const char* CAMERA_BLOCK_NAME = "uCamera";
+	inline constexpr GLuint CAMERA_BLOCK_BINDING = 0;
 	struct context;
 
 	bool extension_supported(const char*);
+#ifdef _WIN32
+	// the loader handed to glad, resolves entry points the generated glad doesn't cover
+	inline GLADloadproc gl_proc_loader = {};
+#else
+	// resolves extension entry points (e.g. eglGetProcAddress), without it gpu timers fall back to cpu time
+	inline void* (*gl_proc_loader)(const char*) = {};
+#endif
+
+	// shadow of the gl bindings the renderer touches, calls that would not change anything are dropped.
+	// code binding gl objects behind its back must go through it or invalidate it
+	class gl_state_cache
+	{
+	public:
+		static const int TEXTURE_UNIT_COUNT = 6;
+
+		gl_state_cache()
+		{
+			invalidate();
+		}
+
+		void use_program(GLuint program)
+		{
+			if (changed(_program, program))
+			{
+				counters.program_switches++;
+				glUseProgram(program);
+			}
+		}
+
+		void bind_vertex_array(GLuint vao)
+		{
+			if (changed(_vao, vao))
+			{
+				glBindVertexArray(vao);
+			}
+		}
+
+		// the array buffer is context state and cached. the element array binding belongs to the bound vao,
+		// so it is always issued, and binds outside a draw go through unbind_vertex_array first
+		void bind_buffer(GLenum target, GLuint buffer)
+		{
+			if (target != GL_ARRAY_BUFFER)
+			{
+				stats.issued++;
+				glBindBuffer(target, buffer);
+				return;
+			}
+			if (changed(_array_buffer, buffer))
+			{
+				glBindBuffer(target, buffer);
+			}
+		}
+
+		// vaos stay bound after draws, an element buffer bound for an upload would replace their indices
+		void unbind_vertex_array()
+		{
+			bind_vertex_array(0);
+		}
+
+		// returns false when the framebuffer was already bound
+		bool bind_framebuffer(GLuint framebuffer)
+		{
+			if (changed(_framebuffer, framebuffer))
+			{
+				counters.framebuffer_switches++;
+				glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+				return true;
+			}
+			return false;
+		}
+
+		void active_texture(int unit)
+		{
+			assert(unit >= 0 && unit < TEXTURE_UNIT_COUNT);
+			if (changed(_active_unit, static_cast<GLuint>(unit)))
+			{
+				glActiveTexture(GL_TEXTURE0 + unit);
+			}
+		}
+
+		// binds on the active unit
+		void bind_texture(GLenum target, GLuint texture)
+		{
+			GLuint* cached = texture_slot(target);
+			if (cached == nullptr || _active_unit == UNKNOWN)
+			{
+				stats.issued++;
+				counters.texture_binds++;
+				glBindTexture(target, texture);
+				return;
+			}
+			if (changed(*cached, texture))
+			{
+				counters.texture_binds++;
+				glBindTexture(target, texture);
+			}
+		}
+
+		void blend_func(GLenum src, GLenum dst)
+		{
+			blend_func(src, dst, src, dst);
+		}
+
+		void blend_func(GLenum src, GLenum dst, GLenum src_alpha, GLenum dst_alpha)
+		{
+			if (_blend_src == src && _blend_dst == dst && _blend_src_alpha == src_alpha && _blend_dst_alpha == dst_alpha)
+			{
+				stats.skipped++;
+				return;
+			}
+			_blend_src = src;
+			_blend_dst = dst;
+			_blend_src_alpha = src_alpha;
+			_blend_dst_alpha = dst_alpha;
+			stats.issued++;
+			if (src == src_alpha && dst == dst_alpha)
+			{
+				glBlendFunc(src, dst);
+			}
+			else
+			{
+				glBlendFuncSeparate(src, dst, src_alpha, dst_alpha);
+			}
+		}
+
+		void viewport(int x, int y, int width, int height)
+		{
+			if (_viewport[0] == x && _viewport[1] == y && _viewport[2] == width && _viewport[3] == height)
+			{
+				stats.skipped++;
+				return;
+			}
+			_viewport[0] = x;
+			_viewport[1] = y;
+			_viewport[2] = width;
+			_viewport[3] = height;
+			stats.issued++;
+			glViewport(x, y, width, height);
+		}
+
+		// deleting a bound object reverts its bindings to 0
+		void forget_texture(GLuint texture)
+		{
+			for (auto& unit : _textures)
+			{
+				for (auto& bound : unit)
+				{
+					if (bound == texture)
+					{
+						bound = 0;
+					}
+				}
+			}
+		}
+
+		void forget_program(GLuint program)
+		{
+			if (_program == program)
+			{
+				_program = UNKNOWN;
+			}
+		}
+
+		void forget_buffer(GLuint buffer)
+		{
+			if (_array_buffer == buffer)
+			{
+				_array_buffer = 0;
+			}
+		}
+
+		void forget_vertex_array(GLuint vao)
+		{
+			if (_vao == vao)
+			{
+				_vao = 0;
+			}
+		}
+
+		void forget_framebuffer(GLuint framebuffer)
+		{
+			if (_framebuffer == framebuffer)
+			{
+				_framebuffer = 0;
+			}
+		}
+
+		void invalidate()
+		{
+			_program = UNKNOWN;
+			_vao = UNKNOWN;
+			_array_buffer = UNKNOWN;
+			_framebuffer = UNKNOWN;
+			_active_unit = UNKNOWN;
+			for (auto& unit : _textures)
+			{
+				for (auto& bound : unit)
+				{
+					bound = UNKNOWN;
+				}
+			}
+			_blend_src = UNKNOWN;
+			_blend_dst = UNKNOWN;
+			_blend_src_alpha = UNKNOWN;
+			_blend_dst_alpha = UNKNOWN;
+			for (auto& v : _viewport)
+			{
+				v = -1;
+			}
+		}
+
+		imr::state_cache_stats stats = {};
+		// running totals, imr::stats reports the difference over a camera pass or a frame
+		imr::stats::counters counters = {};
+
+	private:
+		static const GLuint UNKNOWN = 0xffffffff;
+
+		bool changed(GLuint& cached, GLuint value)
+		{
+			if (cached == value)
+			{
+				stats.skipped++;
+				return false;
+			}
+			cached = value;
+			stats.issued++;
+			return true;
+		}
+
+		GLuint* texture_slot(GLenum target)
+		{
+			if (_active_unit >= TEXTURE_UNIT_COUNT)
+			{
+				return nullptr;
+			}
+			if (target == GL_TEXTURE_2D)
+			{
+				return &_textures[_active_unit][0];
+			}
+			if (target == GL_TEXTURE_2D_ARRAY)
+			{
+				return &_textures[_active_unit][1];
+			}
+			return nullptr;
+		}
+
+		GLuint _program = UNKNOWN;
+		GLuint _vao = UNKNOWN;
+		GLuint _array_buffer = UNKNOWN;
+		GLuint _framebuffer = UNKNOWN;
+		GLuint _active_unit = UNKNOWN;
+		GLuint _textures[TEXTURE_UNIT_COUNT][2] = {}; // 2d, 2d array
+		GLenum _blend_src = UNKNOWN;
+		GLenum _blend_dst = UNKNOWN;
+		GLenum _blend_src_alpha = UNKNOWN;
+		GLenum _blend_dst_alpha = UNKNOWN;
+		int _viewport[4] = {};
+	};
+
+	// the state cache of the context, usable before context is complete
+	gl_state_cache& current_gl_state();
 
 	class array_buffer
 	{
 	public:
+		// an element buffer binds into the bound vao, which is how vaos are set up
 		void bind()
 		{
 			assert(_buffer > 0);
-			glBindBuffer(_target, _buffer);
+			current_gl_state().bind_buffer(_target, _buffer);
 		}
 
 		array_buffer() = delete;
@@ -65,19 +348,32 @@ namespace imr
 			_usage = usage;
 			_capacity = imr::util::min_power_of_2(size);
 			glGenBuffers(1, &_buffer);
-			glBindBuffer(target, _buffer);
+			if (target == GL_ELEMENT_ARRAY_BUFFER)
+			{
+				current_gl_state().unbind_vertex_array();
+			}
+			current_gl_state().bind_buffer(target, _buffer);
 			glBufferData(target, _capacity, data, usage);
-			glBindBuffer(target, 0);
+			current_gl_state().bind_buffer(target, 0);
+			if (data)
+			{
+				current_gl_state().counters.upload_bytes += size;
+			}
 		}
 
 		~array_buffer()
 		{
 			glDeleteBuffers(1, &_buffer);
+			current_gl_state().forget_buffer(_buffer);
 		}
 
 		void unbind()
 		{
-			glBindBuffer(_target, 0);
+			if (_target == GL_ELEMENT_ARRAY_BUFFER)
+			{
+				current_gl_state().unbind_vertex_array();
+			}
+			current_gl_state().bind_buffer(_target, 0);
 		}
 
 		void sub_data(int offset, int size, const void* data)
@@ -85,6 +381,7 @@ namespace imr
 			assert(size <= _capacity);
 			size = std::min(size, _capacity);
 			glBufferSubData(_target, offset, size, data);
+			current_gl_state().counters.upload_bytes += size;
 			GL_ASSERT();
 		}
 
@@ -103,9 +400,200 @@ namespace imr
 	inline std::unique_ptr<array_buffer> create_array_buffer(const void* data, int size, GLenum target, GLenum usage)
 	{
 		auto arr_buf = std::make_unique<array_buffer>(size, target, usage, data);
-		return std::move(arr_buf);
+		return arr_buf;
 	}
 
+	// ring buffer for per-frame uploads.
+	// writes map the ring unsynchronized and each segment is guarded by a fence,
+	// so the cpu only waits when it catches up with a segment the gpu is still reading.
+	class stream_buffer
+	{
+	public:
+		static const int SEGMENT_COUNT = 4;
+
+		stream_buffer() = delete;
+		stream_buffer(int capacity, GLenum target)
+		{
+			_target = target;
+			if (target == GL_ELEMENT_ARRAY_BUFFER)
+			{
+				current_gl_state().unbind_vertex_array();
+			}
+			allocate(capacity);
+		}
+
+		~stream_buffer()
+		{
+			release();
+		}
+
+		// copies data into the ring and leaves the buffer bound, returns the byte offset of the data
+		int write(const void* data, int size, int alignment = 16)
+		{
+			auto [ptr, offset] = map(size, alignment);
+			if (ptr)
+			{
+				memcpy(ptr, data, size);
+			}
+			unmap();
+			return offset;
+		}
+
+		// reserves size bytes and maps them for writing, returns the memory and its byte offset.
+		// the buffer stays mapped and bound until unmap, so several uploads can share one mapping.
+		// an index ring binds into the bound vao, callers bind the vao that draws from it first
+		std::tuple<void*, int> map(int size, int alignment = 16)
+		{
+			assert(size > 0);
+			if (size > _capacity)
+			{
+				// can't wait its way into the ring, grown now
+				grow(size * 2);
+			}
+			else if (size > _capacity / 2)
+			{
+				// spans most of the ring and waits for every segment it covers, grown at the next grow_pending.
+				// the context sizes the ring for a full instancing batch
+				_pending_capacity = std::max(_pending_capacity, size * 2);
+			}
+
+			int offset = (_head + alignment - 1) / alignment * alignment;
+			if (offset + size > _capacity)
+			{
+				// wrap around
+				while (_segment != 0)
+				{
+					next_segment();
+				}
+				offset = 0;
+			}
+			const int last_segment = (offset + size - 1) / segment_size();
+			while (_segment != last_segment)
+			{
+				next_segment();
+			}
+
+			current_gl_state().bind_buffer(_target, _buffer);
+			void* ptr = glMapBufferRange(_target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			assert(ptr);
+			current_gl_state().counters.upload_bytes += size;
+			GL_ASSERT();
+
+			_head = offset + size;
+			return { ptr, offset };
+		}
+
+		void unmap()
+		{
+			glUnmapBuffer(_target);
+			GL_ASSERT();
+		}
+
+		void bind()
+		{
+			current_gl_state().bind_buffer(_target, _buffer);
+		}
+
+		void unbind()
+		{
+			if (_target == GL_ELEMENT_ARRAY_BUFFER)
+			{
+				current_gl_state().unbind_vertex_array();
+			}
+			current_gl_state().bind_buffer(_target, 0);
+		}
+
+		int capacity() const { return _capacity; }
+
+		// applies the growth large uploads asked for, between frames while nothing is mapped
+		void grow_pending()
+		{
+			if (_pending_capacity > _capacity)
+			{
+				if (_target == GL_ELEMENT_ARRAY_BUFFER)
+				{
+					current_gl_state().unbind_vertex_array();
+				}
+				grow(_pending_capacity);
+			}
+			_pending_capacity = 0;
+		}
+
+	private:
+		int segment_size() const { return _capacity / SEGMENT_COUNT; }
+
+		void grow(int capacity)
+		{
+			release();
+			allocate(capacity);
+			current_gl_state().counters.stream_grows++;
+		}
+
+		void next_segment()
+		{
+			// fence the segment being left, then make sure the gpu finished with the one being entered
+			if (_fences[_segment])
+			{
+				glDeleteSync(_fences[_segment]);
+			}
+			_fences[_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			_segment = (_segment + 1) % SEGMENT_COUNT;
+			_head = _segment * segment_size();
+			wait_segment(_segment);
+		}
+
+		void wait_segment(int segment)
+		{
+			if (_fences[segment] == nullptr)
+			{
+				return;
+			}
+			while (true)
+			{
+				auto ret = glClientWaitSync(_fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+				if (ret != GL_TIMEOUT_EXPIRED)
+				{
+					break;
+				}
+			}
+			glDeleteSync(_fences[segment]);
+			_fences[segment] = nullptr;
+		}
+
+		void allocate(int capacity)
+		{
+			_capacity = imr::util::min_power_of_2(capacity);
+			_head = 0;
+			_segment = 0;
+			glGenBuffers(1, &_buffer);
+			current_gl_state().bind_buffer(_target, _buffer);
+			glBufferData(_target, _capacity, nullptr, GL_STREAM_DRAW);
+		}
+
+		void release()
+		{
+			for (auto& fence : _fences)
+			{
+				if (fence)
+				{
+					glDeleteSync(fence);
+				}
+				fence = nullptr;
+			}
+			glDeleteBuffers(1, &_buffer);
+			current_gl_state().forget_buffer(_buffer);
+			_buffer = 0;
+		}
+
+		GLuint _buffer = 0;
+		GLenum _target = {};
+		int _capacity = {};
+		int _pending_capacity = 0;
+		int _head = 0;
+		int _segment = 0;
+		GLsync _fences[SEGMENT_COUNT] = {};
+	};
+
 	struct texture_info : Itexture_info
 	{
 		std::string texture_name = {};
@@ -129,21 +617,99 @@ namespace imr
 		void destroy() override;
 	};
 
+	// atlas pages stacked in one GL_TEXTURE_2D_ARRAY
+	struct texture_array_info : texture_info
+	{
+		int layer_count = 0;
+
+		void bind() const override;
+		void unbind() const override;
+		bool is_array() const override { return true; }
+	};
+
+	// one page of a texture array, batches with every other page of the same array
+	struct texture_layer_info : Itexture_info
+	{
+		std::shared_ptr<texture_array_info> array = {};
+		int index = 0;
+		// the page, a smaller page sits at the top left of the layer
+		int2 page_size = {};
+		std::string texture_name = {};
+
+		const std::string& name() const override { return texture_name; }
+		void set_name(const std::string& n) override { texture_name = n; }
+		int2 size() const override { return page_size; }
+		int width() const override { return page_size.x; }
+		int height() const override { return page_size.y; }
+		void bind() const override { array->bind(); }
+		void unbind() const override { array->unbind(); }
+		void destroy() override { array.reset(); }
+		const Itexture_info* batch_key() const override { return array.get(); }
+		int layer() const override { return index; }
+		bool is_array() const override { return true; }
+		float4 uv_rect() const override
+		{
+			return { 0, 1, static_cast<float>(page_size.x) / array->width(), 1.0f - static_cast<float>(page_size.y) / array->height() };
+		}
+	};
+
+	// handle of load_texture_async, forwards to the white texture until the upload finished
+	struct async_texture_info : Itexture_info
+	{
+		std::string texture_name = {};
+		// set on the gl thread by update_texture_uploads
+		std::shared_ptr<texture_info> texture = {};
+		bool done = false;
+		// result of the decode task, an exception thrown by load_data or the decoder arrives here as a failure
+		result load_result = {};
+
+		const Itexture_info* current() const;
+		const std::string& name() const override { return texture_name; }
+		void set_name(const std::string& n) override { texture_name = n; }
+		int2 size() const override { return current()->size(); }
+		int width() const override { return current()->width(); }
+		int height() const override { return current()->height(); }
+		void bind() const override { current()->bind(); }
+		void unbind() const override { current()->unbind(); }
+		void destroy() override { texture.reset(); }
+		const Itexture_info* batch_key() const override { return current(); }
+		bool ready() const override { return done; }
+	};
+
+	// pixels decoded by a loader worker, waiting for update_texture_uploads
+	struct decoded_texture
+	{
+		// a handle dropped before its upload is skipped
+		std::weak_ptr<async_texture_info> target = {};
+		unsigned char* pixels = {};
+		// a KTX file is kept as is and uploaded without decoding
+		std::vector<char> compressed = {};
+		int width = 0;
+		int height = 0;
+		int channels = 0;
+		result load_result = {};
+	};
+
 	struct frame_buffer : Iframe_buffer
 	{
 	private:
 		int _width = 0;
 		int _height = 0;
 		bool _created = false;
-		int _attachment_count = 1;
+		render_target_desc _desc = {};
 		inline const static unsigned int _attachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+		// every created frame buffer, reported by get_render_target_stats
+		inline static size_t _total_bytes = 0;
 
 	public:
 		GLuint buffer = 0;
 		GLuint color_textures[4] = {};
+		GLuint depth_texture = 0;
 
 		bool discard_on_resolution_changed = true;
 
+		static size_t total_bytes() { return _total_bytes; }
+
 		uintptr_t get_color_texture(int idx = 0) override
 		{
 			return color_textures[idx];
@@ -159,14 +725,24 @@ namespace imr
 
 		imr::result create(int w, int h, int attachment_count = 1) override
 		{
-			assert(attachment_count <= 4);
-			_attachment_count = attachment_count;
+			render_target_desc desc = { .width = w, .height = h, .color_count = attachment_count, .depth = true };
+			return create(desc);
+		}
+
+		imr::result create(const render_target_desc& desc) override
+		{
+			assert(desc.color_count >= 1 && desc.color_count <= 4);
 			imr::result ret;
 
-			if (w > 0 && h > 0)
+			if (desc.width > 0 && desc.height > 0)
 			{
-				_width = w;
-				_height = h;
+				if (_created)
+				{
+					destory();
+				}
+				_desc = desc;
+				_width = desc.width;
+				_height = desc.height;
 			}
 			else
 			{
@@ -185,11 +761,14 @@ namespace imr
 				ret.msg = "create frame buffers fail";
 				return ret;
 			}
+			_created = true;
+			_total_bytes += _desc.bytes();
 
-			glBindFramebuffer(GL_FRAMEBUFFER, buffer);
+			current_gl_state().bind_framebuffer(buffer);
 
-			glGenTextures(attachment_count, color_textures);
-			for (int i = 0; i < attachment_count; ++i)
+			const GLint filter = desc.filter == render_target_filter::linear ? GL_LINEAR : GL_NEAREST;
+			glGenTextures(desc.color_count, color_textures);
+			for (int i = 0; i < desc.color_count; ++i)
 			{
 				assert(color_textures[i] > 0);
 				if (color_textures[i] <= 0)
@@ -200,71 +779,128 @@ namespace imr
 					return ret;
 				}
 
-				glBindTexture(GL_TEXTURE_2D, color_textures[i]);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				current_gl_state().bind_texture(GL_TEXTURE_2D, color_textures[i]);
+				switch (desc.color_formats[i])
+				{
+				case render_target_format::r8:
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, _width, _height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+					break;
+				case render_target_format::rgba16f:
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, _width, _height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+					break;
+				default:
+					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+					break;
+				}
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 				glFramebufferTexture2D(GL_FRAMEBUFFER, _attachments[i], GL_TEXTURE_2D, color_textures[i], 0);
 			}
 
-			GLuint depth_texture = 0;
-			glGenTextures(1, &depth_texture);
-			glBindTexture(GL_TEXTURE_2D, depth_texture);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, _width, _height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-			glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
-
-			glBindTexture(GL_TEXTURE_2D, 0);
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			if (desc.depth)
+			{
+				glGenTextures(1, &depth_texture);
+				current_gl_state().bind_texture(GL_TEXTURE_2D, depth_texture);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, _width, _height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+				glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
+			}
 
-			_created = true;
+			current_gl_state().bind_texture(GL_TEXTURE_2D, 0);
+			current_gl_state().bind_framebuffer(0);
 			return ret;
 		}
 
 		void destory() override
 		{
+			if (_created)
+			{
+				_total_bytes -= _desc.bytes();
+			}
+			_created = false;
+			current_gl_state().forget_framebuffer(buffer);
 			glDeleteFramebuffers(1, &buffer);
 			buffer = 0;
 			for (int i = 0; i < 4; ++i)
 			{
 				if (color_textures[i] > 0)
+				{
+					current_gl_state().forget_texture(color_textures[i]);
 					glDeleteTextures(1, &color_textures[i]);
+				}
 				color_textures[i] = 0;
 			}
+			if (depth_texture > 0)
+			{
+				current_gl_state().forget_texture(depth_texture);
+				glDeleteTextures(1, &depth_texture);
+			}
+			depth_texture = 0;
 		}
 
 		void bind() override
 		{
-			glBindFramebuffer(GL_FRAMEBUFFER, buffer);
-			glDrawBuffers(_attachment_count, _attachments);
+			// draw buffers are framebuffer state, set again only when the binding changed
+			if (current_gl_state().bind_framebuffer(buffer))
+			{
+				glDrawBuffers(_desc.color_count, _attachments);
+			}
 		}
 
 		void unbind() override
 		{
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			current_gl_state().bind_framebuffer(0);
 		}
 
+		const render_target_desc& desc() const { return _desc; }
 		int width() const override { return _width; }
 		int height() const override { return _height; }
 		void bind_color_texture(int attachment_idx = 0) override
 		{
-			glBindTexture(GL_TEXTURE_2D, color_textures[attachment_idx]);
+			current_gl_state().bind_texture(GL_TEXTURE_2D, color_textures[attachment_idx]);
 		}
 	};
 
+	// a cached tessellation keeps its inputs, a hash hit builds again when they differ
+	struct shape_cache_entry
+	{
+		uint64_t key = 0;
+		std::vector<float2> points = {};
+		std::vector<float> style = {};
+		imr::mesh::draw_args mesh = {};
+	};
+
+	// a target owned by the render target pool
+	struct pooled_render_target
+	{
+		std::shared_ptr<frame_buffer> target = {};
+		// handed out by acquire_transient_render_target this frame
+		bool transient = false;
+		int idle_frames = 0;
+
+		// nobody but the pool holds it
+		bool free() const { return transient == false && target.use_count() == 1; }
+	};
+
 	class program : public Iprogram
 	{
 	public:
+		// attribute and uniform regs index flat tables, TEXTURE_REG_5 is the highest built-in one
+		static const int MAX_REG = 128;
+
 		program(GLuint prg)
 			:_program(prg)
 		{
+			_attrib_loc.fill(UNBOUND);
+			_uniform_loc.fill(UNBOUND);
 		}
 		void use() override;
 		void unuse() override;
 		void destroy() override;
 		void bind_attrib_location(int reg, const char* attr)
 		{
+			assert(reg >= 0 && reg < MAX_REG);
 			auto loc = glGetAttribLocation(_program, attr);
 			assert(loc >= 0);
 			_attrib_loc[reg] = loc;
@@ -272,14 +908,15 @@ namespace imr
 
 		void bind_uniform_location(int reg, const char* uni)
 		{
+			assert(reg >= 0 && reg < MAX_REG);
 			auto loc = glGetUniformLocation(_program, uni);
 			assert(loc >= 0);
 			_uniform_loc[reg] = loc;
 		}
 
-		GLint get_attrib_location(int reg)
+		GLint get_attrib_location(int reg) const
 		{
-			if (_attrib_loc.find(reg) == _attrib_loc.end())
+			if (reg < 0 || reg >= MAX_REG || _attrib_loc[reg] == UNBOUND)
 			{
 				assert(false);
 				return -1;
@@ -287,38 +924,58 @@ namespace imr
 			return _attrib_loc[reg];
 		}
 
-		const GLint get_uniform_location(int reg) const
+		bool has_uniform_location(int reg) const
+		{
+			return reg >= 0 && reg < MAX_REG && _uniform_loc[reg] != UNBOUND;
+		}
+
+		GLint get_uniform_location(int reg) const
 		{
-			if (_uniform_loc.find(reg) == _uniform_loc.end())
+			if (has_uniform_location(reg) == false)
 			{
 				assert(false);
 				return -1;
 			}
-			return _uniform_loc.at(reg);
+			return _uniform_loc[reg];
 		}
 	private:
+		static const GLint UNBOUND = -2;
 		GLuint _program = 0;
-		std::unordered_map<int, GLint> _attrib_loc = {};
-		std::unordered_map<int, GLint> _uniform_loc = {};
+		std::array<GLint, MAX_REG> _attrib_loc = {};
+		std::array<GLint, MAX_REG> _uniform_loc = {};
 	};
 
-	class program_builder
+	// compile and link issued by program_builder::issue, nothing checked yet
+	struct pending_program
 	{
-	public:
-		static std::tuple<imr::result, std::shared_ptr<program>> build(const char* vs, const char* fs);
-	private:
-		static std::tuple<imr::result, GLuint> load_shader(GLenum type, const char* code);
+		GLuint program = 0;
+		GLuint vertex_shader = 0;
+		GLuint fragment_shader = 0;
+		const char* vs = {};
+		const char* fs = {};
+		bool camera_block = false;
+		// loaded from the program cache, rebuilt from the sources when the driver rejects it
+		bool from_binary = false;
+		uint64_t cache_key = 0;
 	};
 
-	struct camera_state
+	class program_builder
 	{
-		bool begin = false;
-		glm::mat4x4 projection = glm::mat4x4(1.0f);
-		glm::mat4x4 view = glm::mat4x4(1.0f);
-		Iframe_buffer* frame = {};
-		bool try_batch = false;
-		float4 world_rect = {};
-		std::vector<imr::sprite::draw_args> batches = {};
+	public:
+		// with camera_block both stages get the uCamera uniform block (see camera_block)
+		static std::tuple<imr::result, std::shared_ptr<program>> build(const char* vs, const char* fs, bool camera_block = false);
+		// starts compiling and linking without reading any status so drivers can compile several programs at once.
+		// vs and fs must outlive finish
+		static pending_program issue(const char* vs, const char* fs, bool camera_block = false);
+		// waits for the link, reports errors and stores the binary in the program cache.
+		// the pending program is taken over and left empty, whether it linked or not
+		static std::tuple<imr::result, std::shared_ptr<program>> finish(pending_program& pending);
+		// deletes an issued program that will never be finished, e.g. after an earlier one failed
+		static void release(pending_program& pending);
+	private:
+		static void compile_and_link(pending_program& pending);
+		static GLuint compile_shader(GLenum type, const char* code, bool camera_block);
+		static imr::result shader_status(GLuint shader);
 	};
 
 	struct viewport_state
@@ -333,38 +990,195 @@ namespace imr
 	{
 		GLenum src = {};
 		GLenum dst = {};
+		// alpha blends with its own factors when set, like color otherwise
+		bool separate_alpha = false;
+		GLenum src_alpha = {};
+		GLenum dst_alpha = {};
+
+		bool operator==(const blend_func_state&) const = default;
+	};
+
+	struct vert_attrib_pointer
+	{
+		int location;
+		int count;
+		int stride;
+		int offset;
+	};
+
+	struct uniform_value
+	{
+		enum uniform_type
+		{
+			mat4,
+			vec4,
+		};
+		uniform_type type = vec4;
+		int location = 0;
+		int length = 0;
+		int offset = 0; // in command_list::uniform_data
+	};
+
+	struct draw_command
+	{
+		static const int MAX_TEXTURE_COUNT = 6;
+		enum command_type
+		{
+			instancing,
+			mesh,
+		};
+		command_type type = instancing;
+		imr::program* program = {};
+		const Itexture_info* textures[MAX_TEXTURE_COUNT] = {};
+		blend_func_state blend = {};
+		// instancing
+		bool compact_instance = false;
+		int instance_offset = 0; // in floats of command_list::instances
+		int instance_count = 0;
+		// mesh
+		bool use_project_view_matrix = true;
+		int vertex_stride = 0;
+		int vertex_offset = 0;
+		int vertex_count = 0;
+		int index_offset = 0;
+		int index_count = 0;
+		int attrib_offset = 0;
+		int attrib_count = 0;
+		int uniform_offset = 0;
+		int uniform_count = 0;
+	};
+
+	// draws recorded between camera::begin and camera::end of a deferred camera
+	struct command_list
+	{
+		std::vector<draw_command> commands = {};
+		std::vector<float> instances = {};
+		std::vector<float> vertices = {};
+		std::vector<uint32_t> indices = {};
+		std::vector<vert_attrib_pointer> attrib_pointers = {};
+		std::vector<uniform_value> uniforms = {};
+		std::vector<float> uniform_data = {};
+
+		void clear()
+		{
+			commands.clear();
+			instances.clear();
+			vertices.clear();
+			indices.clear();
+			attrib_pointers.clear();
+			uniforms.clear();
+			uniform_data.clear();
+		}
+	};
+
+	// std140 data of the uCamera block, written when the current camera changes
+	struct camera_block
+	{
+		glm::mat4 projection = glm::mat4(1.0f);
+		glm::mat4 view = glm::mat4(1.0f);
+		float4 resolution_time = {}; // frame width, height, seconds since initialize, rev
+	};
+
+	struct camera_state
+	{
+		bool begin = false;
+		glm::mat4x4 projection = glm::mat4x4(1.0f);
+		glm::mat4x4 view = glm::mat4x4(1.0f);
+		// derived from projection and view when the camera changes, screen_to_world / world_to_screen read these
+		glm::mat4x4 inverse_projection = glm::mat4x4(1.0f);
+		glm::mat4x4 view_projection = glm::mat4x4(1.0f);
+		glm::mat4x4 inverse_view_projection = glm::mat4x4(1.0f);
+		Iframe_buffer* frame = {};
+		bool try_batch = false;
+		float4 world_rect = {};
+		std::vector<imr::sprite::draw_args> batches = {};
+		bool layered = false;
+		bool y_sort = false;
+		std::vector<imr::sprite::draw_args> layered_sprites = {};
+		std::vector<sort_item> layered_keys = {};
+		std::vector<std::array<const Itexture_info*, 4>> layered_materials = {}; // batch keys of the 4 textures, numbered in first seen order
+		command_list* commands = {};
+		// mesh::draw calls of an immediate camera, merged while the material repeats (the unused command list of this depth)
+		command_list* mesh_batch = {};
+		bool culling = false;
+		// imr::stats of the pass, timer_query is 0 when the pass is cpu timed
+		imr::stats::counters start_counters = {};
+		std::chrono::steady_clock::time_point start_time = {};
+		GLuint timer_query = 0;
 	};
 
 	struct instancing_state
 	{
-		static const int MAX_INSTSANCE_COUNT = 100000;
-		static const int INSTANCE_FORMAT_COUNT = 20; // translate, scale / rotation, width, height, rev / uv_rect / color / offset, rev
-		static const int INSTANCE_FORMAT_SIZE = INSTANCE_FORMAT_COUNT * sizeof(float); // translate, scale / rotation, width, height, rev / uv_rect / color / offset, rev
-		inline static std::vector<float> SHARE_BUFFER = std::vector<float>(MAX_INSTSANCE_COUNT * INSTANCE_FORMAT_SIZE);
+		static const int MAX_INSTSANCE_COUNT = 100000; // staged instances are drawn and the staging reused past this count
+		static const int INSTANCE_FORMAT_COUNT = 20; // translate, scale / rotation, width, height, layer / uv_rect / color / offset, normal map sign, rev
+		static const int INSTANCE_FORMAT_SIZE = INSTANCE_FORMAT_COUNT * sizeof(float);
+		static const int COMPACT_INSTANCE_FORMAT_COUNT = 8; // translate / linear transform (half) / uv_rect (unorm16) / color (rgba8) / scale x sign, layer (half)
+		static const int COMPACT_INSTANCE_FORMAT_SIZE = COMPACT_INSTANCE_FORMAT_COUNT * sizeof(float);
 		bool begin = false;
+		bool compact = false;
 		int instance_count = 0;
+		float layer = 0; // layer of the begun texture, instances of a sprite or of another page write their own
+		std::vector<float>* staging = {}; // owned by context, one per stack level
+		program_handle program = INVALID_PROGRAM_HANDLE; // draws this level instead of the pushed program, levels begun inside keep theirs
+
+		int format_count() const { return compact ? COMPACT_INSTANCE_FORMAT_COUNT : INSTANCE_FORMAT_COUNT; }
 		const Itexture_info* texture_info = {};
 		const Itexture_info* texture_info_1 = {};
 		const Itexture_info* texture_info_2 = {};
 		const Itexture_info* texture_info_3 = {};
 	};
 
-	struct mesh_state
+	// writes count instances of args from first in the 20 float instance format (imr_instancing_simd.cpp).
+	// with indices, item k is args[indices[first + k]]
+	// instances without a sprite draw the whole begun texture, texture_size and texture_uv, at layer
+	void pack_instances(float* dst, const imr::instancing::instance_many_args& args, const uint32_t* indices, size_t first, size_t count, const float2& texture_size, const float4& texture_uv, float layer);
+	// writes the indices of instances whose bounds touch rect (min xy, max zw), returns how many
+	size_t cull_instances(uint32_t* visible, const imr::instancing::instance_many_args& args, size_t count, const float2& texture_size, const float4& rect);
+	// radius around the position that contains the rotated quad
+	inline float bounding_radius(const float2& size, const float2& scale, const float2& offset)
 	{
-		struct vert_attrib_pointer
-		{
-			int location;
-			int count;
-			int stride;
-			int offset;
+		float ex = std::max(std::abs(offset.x), std::abs(1.0f - offset.x)) * std::abs(size.x * scale.x);
+		float ey = std::max(std::abs(offset.y), std::abs(1.0f - offset.y)) * std::abs(size.y * scale.y);
+		return std::sqrt(ex * ex + ey * ey);
+	}
+	inline bool outside_rect(const float4& rect, const float2& center, float radius)
+	{
+		return center.x + radius < rect.x || center.x - radius > rect.z || center.y + radius < rect.y || center.y - radius > rect.w;
+	}
+	// uv rect of a pixel rect counted from the top left of the texture, or of the page for a texture array page
+	inline float4 texture_uv_rect(const Itexture_info* texture, const float2& position, const float2& size)
+	{
+		const float4 page = texture->uv_rect();
+		const float2 lt = position / texture->size();
+		const float2 rb = (position + size) / texture->size();
+		return {
+			page.x + lt.x * (page.z - page.x),
+			page.y + lt.y * (page.w - page.y),
+			page.x + rb.x * (page.z - page.x),
+			page.y + rb.y * (page.w - page.y)
 		};
+	}
+
+	// merged geometry of one mesh stack level, kept by the context so nested meshes don't share it and
+	// the capacity is reused by the next mesh at the same depth
+	struct mesh_buffers
+	{
+		std::vector<float> vertices = {};
+		std::vector<uint32_t> indices = {};
+	};
+
+	struct mesh_state
+	{
 		bool begin = false;
 		bool use_project_view_matrix = true;
 		imr::program* program = {};
+		int vertex_stride = 0;
 		std::vector<std::pair<int, Itexture_info*>> textures = {};
 		std::vector<vert_attrib_pointer> vert_attrib_pointers = {};
-		inline static std::vector<float> vertices = {};
-		inline static std::vector<unsigned short> indices = {};
+		std::vector<uniform_value> uniforms = {};
+		std::vector<float> uniform_data = {};
+		// geometry of this stack level, owned by context::mesh_levels
+		mesh_buffers* buffers = {};
 	};
 
 	struct text_state
@@ -384,37 +1198,188 @@ namespace imr
 		std::stack<viewport_state> viewport_stack = {};
 		std::stack<blend_func_state> blend_func_stack = {};
 		std::stack<instancing_state> instancing_stack = {};
-		std::stack<std::string> program_stack = {};
+		std::stack<program_handle> program_stack = {};
 		std::stack<mesh_state> mesh_stack = {};
+		// mesh_buffers per mesh_stack depth, a deque so levels stay put while it grows
+		std::deque<mesh_buffers> mesh_levels = {};
 		std::stack<text_state> text_stack = {};
 		std::shared_ptr<Itexture_info> white_texture_info = {};
-		std::unordered_map<std::string, std::shared_ptr<imr::Iprogram>> programs = {};
+		// program table indexed by handle, unregistered slots are null until regist_program reuses them
+		std::vector<std::shared_ptr<imr::Iprogram>> programs = {};
+		// the same table cast once to the gl program, null for other Iprogram implementations
+		std::vector<program*> gl_programs = {};
+		// generation per slot, bumped when the slot is unregistered
+		std::vector<uint32_t> program_generations = {};
+		std::unordered_map<std::string, program_handle> program_handles = {};
+		struct builtin_program_handles
+		{
+			program_handle instancing = INVALID_PROGRAM_HANDLE;
+			program_handle instancing_compact = INVALID_PROGRAM_HANDLE;
+			program_handle instancing_array = INVALID_PROGRAM_HANDLE;
+			program_handle instancing_compact_array = INVALID_PROGRAM_HANDLE;
+			program_handle text = INVALID_PROGRAM_HANDLE;
+			program_handle primitive = INVALID_PROGRAM_HANDLE;
+			program_handle sprite = INVALID_PROGRAM_HANDLE;
+			program_handle mesh = INVALID_PROGRAM_HANDLE;
+		};
+		builtin_program_handles builtin_programs = {};
+		gl_state_cache gl_state = {};
+		GLuint camera_ubo = 0;
+		std::chrono::steady_clock::time_point start_time = {};
 		GLuint quad_vao = 0;
-		GLuint instancing_attrib_vao = 0;
 		GLuint temp_vao = {};
-		std::map<std::tuple<int, GLenum, GLenum>, std::stack<std::unique_ptr<array_buffer>>> array_buffer_pool = {};
+		// attribute arrays enabled on temp_vao, a bit per location
+		uint32_t temp_vao_attribs = 0;
+		std::unique_ptr<array_buffer> quad_vertices = {};
+		std::unique_ptr<array_buffer> quad_indices = {};
+		// instancing vao per program, attribute arrays and divisors are set once
+		std::unordered_map<const program*, GLuint> instancing_vaos = {};
+		std::vector<std::unique_ptr<command_list>> command_lists = {};
+		// instance data and mesh vertices share the vertex ring, half of it holds a full instancing batch
+		static const int VERTEX_STREAM_CAPACITY = 16 * 1024 * 1024;
+		static const int INDEX_STREAM_CAPACITY = 1024 * 1024;
+		static_assert(VERTEX_STREAM_CAPACITY / 2 >= instancing_state::MAX_INSTSANCE_COUNT * instancing_state::INSTANCE_FORMAT_SIZE);
+		std::unique_ptr<stream_buffer> vertex_stream = {};
+		std::unique_ptr<stream_buffer> index_stream = {};
+
+		imr::camera::cull_stats cull_stats = {};
+		std::vector<uint32_t> visible_indices = {};
 
-		std::unique_ptr<array_buffer> get_array_buffer(int size, GLenum target, GLenum usage)
+		// imr::stats. a frame waits in pending_stats until the timer queries of its passes resolve,
+		// pass_queries[i] is the query of frame.cameras[i] or 0
+		struct stats_record
 		{
-			auto& pool = array_buffer_pool[std::make_tuple(imr::util::min_power_of_2(size), target, usage)];
-			if (pool.empty())
+			imr::stats::frame frame = {};
+			std::vector<GLuint> pass_queries = {};
+		};
+		static const size_t MAX_PENDING_STATS = 8;
+		bool timer_query_supported = false;
+		bool timer_query_active = false;
+		std::vector<GLuint> free_timer_queries = {};
+		stats_record recording_stats = {};
+		imr::stats::counters frame_start_counters = {};
+		std::chrono::steady_clock::time_point frame_start_time = {};
+		std::deque<stats_record> pending_stats = {};
+		std::vector<imr::stats::frame> stats_history = {};
+		uint64_t stats_frame_index = 0;
+
+		GLuint acquire_timer_query()
+		{
+			if (free_timer_queries.empty())
 			{
-				return create_array_buffer(nullptr, size, target, usage);
+				GLuint query = 0;
+				glGenQueries(1, &query);
+				return query;
 			}
-			else
+			GLuint query = free_timer_queries.back();
+			free_timer_queries.pop_back();
+			return query;
+		}
+
+		// sprite::end_layered scratch
+		std::vector<sort_item> sort_scratch = {};
+
+		// workers for instancing::instance_parallel, created on first use
+		std::unique_ptr<thread_pool> workers = {};
+
+		// load_texture_async decoders, created on first use. finished decodes wait in decoded_textures
+		std::unique_ptr<task_queue> loaders = {};
+		std::mutex decoded_mutex = {};
+		std::deque<decoded_texture> decoded_textures = {};
+
+		// primitive::polygon and polyline tessellations, most recently drawn first.
+		// past MAX_SHAPE_CACHE the least recently drawn one is dropped
+		static const size_t MAX_SHAPE_CACHE = 4096;
+		std::list<shape_cache_entry> shape_cache = {};
+		std::unordered_map<uint64_t, std::list<shape_cache_entry>::iterator> shape_cache_index = {};
+		// tessellation of an uncached shape
+		imr::mesh::draw_args shape_scratch = {};
+
+		// acquire_render_target pool, searched linearly since a frame uses a handful of targets
+		std::vector<pooled_render_target> render_targets = {};
+
+		struct layer_cache_entry
+		{
+			std::shared_ptr<Iframe_buffer> target = {};
+			frame_buffer_texture_info texture{ nullptr };
+			// world region covered by the target and world units per texel
+			float4 world_rect = {};
+			float2 texel = {};
+			// world units per screen pixel of the camera it was recorded for, a zoom records it again
+			float2 camera_units = {};
+			bool fixed_region = false;
+			bool valid = false;
+		};
+		std::unordered_map<std::string, layer_cache_entry> layer_caches = {};
+		// between layer_cache::begin and end, recording when a nested camera draws into the entry
+		layer_cache_entry* layer_cache_current = {};
+		bool layer_cache_recording = false;
+
+		task_queue* get_loaders()
+		{
+			if (loaders == nullptr)
+			{
+				auto hardware = std::thread::hardware_concurrency();
+				loaders = std::make_unique<task_queue>(std::clamp<size_t>(hardware / 2, 1, 4));
+			}
+			return loaders.get();
+		}
+
+		thread_pool* get_workers()
+		{
+			if (workers == nullptr)
+			{
+				auto hardware = std::thread::hardware_concurrency();
+				workers = std::make_unique<thread_pool>(hardware > 1 ? hardware - 1 : 1);
+			}
+			return workers.get();
+		}
+
+		// instancing staging per instancing stack level so nested begin/end don't overwrite each other
+		std::vector<std::unique_ptr<std::vector<float>>> instance_stagings = {};
+
+		std::vector<float>* get_instance_staging(size_t depth)
+		{
+			while (instance_stagings.size() <= depth)
+			{
+				instance_stagings.push_back(std::make_unique<std::vector<float>>());
+			}
+			return instance_stagings[depth].get();
+		}
+
+		size_t instance_staging_bytes() const
+		{
+			size_t ret = 0;
+			for (auto& staging : instance_stagings)
+			{
+				ret += staging->capacity() * sizeof(float);
+			}
+			return ret;
+		}
+
+		command_list* get_command_list(size_t depth)
+		{
+			while (command_lists.size() <= depth)
 			{
-				auto ret = std::move(pool.top());
-				pool.pop();
-				return std::move(ret);
+				command_lists.push_back(std::make_unique<command_list>());
 			}
+			auto* ret = command_lists[depth].get();
+			ret->clear();
+			return ret;
 		}
 
-		void release_array_buffer(std::unique_ptr<array_buffer> ptr)
+
+		program* get_program(program_handle handle) const
 		{
-			auto& pool = array_buffer_pool[ptr->key()];
-			pool.push(std::move(ptr));
+			if (handle.slot < 0 || handle.slot >= static_cast<int>(gl_programs.size()) || program_generations[handle.slot] != handle.generation)
+			{
+				return nullptr;
+			}
+			return gl_programs[handle.slot];
 		}
 
+		GLuint get_instancing_vao(program* prg);
+
 		result create();
 		void destroy();
 	};
@@ -90,7 +90,7 @@ namespace imr::spine
 		ret->animation_state.reset(new ::spine::AnimationStateData(ret->skeleton.get()));
 		ret->animation_state->setDefaultMix(0.5f);
 
-		return { {}, ret };
+		return { result{}, ret };
 	}
 
 	result regist_spine_data(const std::string& name, std::shared_ptr<spine_data> data)
@@ -117,7 +117,7 @@ namespace imr::spine
 		ret->data = data;
 		ret->skeleton = std::make_shared<::spine::Skeleton>(data->skeleton.get());
 		ret->animation_state = std::make_shared<::spine::AnimationState>(data->animation_state.get());
-		return { {}, ret };
+		return { result{}, ret };
 	}
 
 	void spine_instance::set_position(const float2& pos)
@@ -151,6 +151,7 @@ namespace imr::spine
 		imr::Itexture_info* texture = {};
 		imr::Itexture_info* prev_texture = {};
 		imr::float4 color = {};
+		const imr::program_handle mesh_program = imr::get_program_handle(imr::MESH_PROGRAM_NAME);
 		for (unsigned i = 0; i < skeleton->getSlots().size(); ++i) {
 			::spine::Slot& slot = *skeleton->getDrawOrder()[i];
 			::spine::Attachment* attachment = slot.getAttachment();
@@ -245,13 +246,13 @@ namespace imr::spine
 				prev_texture = texture;
 				imr::mesh::end();
 				imr::mesh::begin();
-				imr::mesh::use_program(imr::MESH_PROGRAM_NAME);
+				imr::mesh::use_program(mesh_program);
 				imr::mesh::set_texture(0, texture);
 				imr::mesh::vertex_attrib_pointer(0, 4, 8, 0);
 				imr::mesh::vertex_attrib_pointer(1, 4, 8, 4);
 			}
 			std::vector<imr::mesh::vertex> verts = {};
-			for (auto i = 0, j = 0; i < verticesCount; ++i, j += 2)
+			for (size_t i = 0, j = 0; i < verticesCount; ++i, j += 2)
 			{
 				auto& v = verts.emplace_back();
 				v.position.x = vertices->operator[](j);
@@ -6,7 +6,7 @@
 class font_test_scene : public imr::game::Iscene
 {
 private:
-	std::shared_ptr<imr::frame_buffer> _frame_buffer = {};
+	std::shared_ptr<imr::Iframe_buffer> _frame_buffer = {};
 	imr::text::font_info _font = {};
 
 public:
@@ -22,8 +22,7 @@ public:
 	}
 	imr::result load_resource() override
 	{
-		_frame_buffer = std::make_shared<imr::frame_buffer>();
-		_frame_buffer->create(640, 360);
+		_frame_buffer = imr::acquire_render_target({ .width = 640, .height = 360, .depth = true });
 
 		_font.create("resources/font/neodgm.ttf", 0, 24);
 		return {};
@@ -107,6 +107,10 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR szCmdPar
 	{
 		std::ifstream is = {};
 		is.open(path, std::ios::binary);
+		if (is.is_open() == false)
+		{
+			return std::vector<char>{};
+		}
 		is.seekg(0, std::ios::end);
 		auto length = is.tellg();
 		is.seekg(0, std::ios::beg);
@@ -115,6 +119,15 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR szCmdPar
 		is.close();
 		return ret;
 	};
+	imr::save_data = [](const std::string& path, const std::vector<char>& data)
+	{
+		std::error_code ec = {};
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+		std::ofstream os(path, std::ios::binary);
+		os.write(data.data(), data.size());
+		return os.good();
+	};
+	imr::program_cache_dir = "program_cache";
 
 	// create window
 	glfwSetErrorCallback(glfw_error_callback);
@@ -135,6 +148,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR szCmdPar
 		return 1;
 	glfwMakeContextCurrent(window);
 	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+	imr::gl_proc_loader = (GLADloadproc)glfwGetProcAddress;
 	glfwSwapInterval(1);
 
 	{
@@ -197,6 +211,9 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR szCmdPar
 	{
 		glfwPollEvents();
 		poll_keyboard_input(window);
+		imr::stats::update();
+		imr::update_texture_uploads();
+		imr::update_render_targets();
 
 		smr->on_update();
 
@@ -224,6 +241,42 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR szCmdPar
 			}
 			ImGui::End();
 
+			if (ImGui::Begin("render stats"))
+			{
+				const auto& frame = imr::stats::latest();
+				const bool gpu = imr::stats::gpu_timer_supported();
+				if (gpu)
+				{
+					ImGui::Text("frame %llu - cpu %.2f ms, gpu %.2f ms", static_cast<unsigned long long>(frame.index), frame.cpu_ms, frame.gpu_ms);
+				}
+				else
+				{
+					ImGui::Text("frame %llu - cpu %.2f ms, no gpu timer", static_cast<unsigned long long>(frame.index), frame.cpu_ms);
+				}
+				ImGui::Text("draw calls %zu, instances %zu, vertices %zu", frame.work.draw_calls, frame.work.instances, frame.work.vertices);
+				ImGui::Text("uploads %.1f KB, programs %zu, textures %zu, framebuffers %zu, stream grows %zu", frame.work.upload_bytes / 1024.0f, frame.work.program_switches, frame.work.texture_binds, frame.work.framebuffer_switches, frame.work.stream_grows);
+
+				static std::vector<float> times;
+				static std::vector<float> draw_calls;
+				times.clear();
+				draw_calls.clear();
+				for (auto& f : imr::stats::history())
+				{
+					times.push_back(static_cast<float>(gpu ? f.gpu_ms : f.cpu_ms));
+					draw_calls.push_back(static_cast<float>(f.work.draw_calls));
+				}
+				ImGui::PlotLines(gpu ? "gpu ms" : "cpu ms", times.data(), static_cast<int>(times.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+				ImGui::PlotLines("draw calls", draw_calls.data(), static_cast<int>(draw_calls.size()), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+				for (auto& pass : frame.cameras)
+				{
+					ImGui::Text("%*s%dx%d %.2f ms %s - draws %zu, instances %zu, uploads %.1f KB",
+						pass.depth * 2, "", pass.size.x, pass.size.y, pass.ms, pass.gpu_timed ? "gpu" : "cpu",
+						pass.work.draw_calls, pass.work.instances, pass.work.upload_bytes / 1024.0f);
+				}
+			}
+			ImGui::End();
+
 			if (ImGui::Begin((char*)u8"debug"))
 			{
 				const char* scenes[3] = { "spine & box2d test", "performance test", "text rendering test" };
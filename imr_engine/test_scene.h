@@ -29,7 +29,7 @@ private:
 	std::shared_ptr<imr::Itexture_info> _atlas_texture_info = {};
 	std::shared_ptr<imr::atlas_info> _atlas_info = {};
 	std::shared_ptr<imr::sprite::animation::animation_state> _animation_state = {};
-	std::shared_ptr<imr::frame_buffer> _frame_buffer = {};
+	std::shared_ptr<imr::Iframe_buffer> _frame_buffer = {};
 
 public:
 	const std::shared_ptr<imr::Iframe_buffer> get_frame_buffer() const override { return _frame_buffer; }
@@ -37,10 +37,8 @@ public:
 	imr::result load_resource() override
 	{
 		parse_cards_json();
-		auto [res, tex_info] = imr::load_texture("haul.png");
-		_haul_texture_info = tex_info;
-		auto [resa, _tex_info] = imr::load_texture("pocketmon.png");
-		_pocketmon_texture_info = _tex_info;
+		_haul_texture_info = imr::load_texture_async("haul.png");
+		_pocketmon_texture_info = imr::load_texture_async("pocketmon.png");
 
 		auto [r, _tex_info_] = imr::load_texture("atlas.png");
 		_atlas_texture_info = _tex_info_;
@@ -58,8 +56,7 @@ public:
 		_animation_state->set_animation_state_data(state_data);
 		_animation_state->set_animation("run", true);
 
-		_frame_buffer = std::make_shared<imr::frame_buffer>();
-		_frame_buffer->create(800, 600);
+		_frame_buffer = imr::acquire_render_target({ .width = 800, .height = 600, .depth = true });
 
 		return {};
 	}
@@ -465,22 +462,16 @@ private:
 			if (type == b2Shape::Type::e_polygon)
 			{
 				b2PolygonShape* shape = dynamic_cast<b2PolygonShape*>(fixture->GetShape());
-				b2Vec2 p0 = b2Mul(trans, shape->m_vertices[0]);
-				for (int i = 1; i < shape->m_count; ++i)
+				imr::float2 points[b2_maxPolygonVertices] = {};
+				for (int i = 0; i < shape->m_count; ++i)
 				{
-					b2Vec2 p1 = b2Mul(trans, shape->m_vertices[i]);
-					imr::primitive::line({
-						.from = {unit_to_pixel(p0.x), unit_to_pixel(p0.y)},
-						.to = {unit_to_pixel(p1.x), unit_to_pixel(p1.y)},
-						.thickness = 2,
-						.color = {1, 0, 0, 1},
-					});
-					p0 = p1;
+					b2Vec2 p = b2Mul(trans, shape->m_vertices[i]);
+					points[i] = imr::float2(unit_to_pixel(p.x), unit_to_pixel(p.y));
 				}
-				b2Vec2 first = b2Mul(trans, shape->m_vertices[0]);
-				imr::primitive::line({
-					.from = {unit_to_pixel(p0.x), unit_to_pixel(p0.y)},
-					.to = {unit_to_pixel(first.x), unit_to_pixel(first.y)},
+				// bodies move every frame, so the outline isn't worth caching
+				imr::primitive::polygon({
+					.points = { points, static_cast<size_t>(shape->m_count) },
+					.filled = false,
 					.thickness = 2,
 					.color = {1, 0, 0, 1},
 				});
@@ -518,7 +509,7 @@ private:
 	std::shared_ptr<imr::Itexture_info> _atlas_texture_info = {};
 	std::shared_ptr<imr::atlas_info> _atlas_info = {};
 	std::shared_ptr<imr::sprite::animation::animation_state> _animation_state = {};
-	std::shared_ptr<imr::frame_buffer> _frame_buffer = {};
+	std::shared_ptr<imr::Iframe_buffer> _frame_buffer = {};
 
 public:
 	const std::shared_ptr<imr::Iframe_buffer> get_frame_buffer() const override { return _frame_buffer; }
@@ -550,8 +541,7 @@ public:
 		_animation_state->set_animation_state_data(state_data);
 		_animation_state->set_animation("run", true);
 
-		_frame_buffer = std::make_shared<imr::frame_buffer>();
-		_frame_buffer->create(800, 600);
+		_frame_buffer = imr::acquire_render_target({ .width = 800, .height = 600, .depth = true });
 		return {};
 	}
 	imr::result unload_resource() override
@@ -574,7 +564,7 @@ public:
 		{
 			imr::camera::clear({ 1, 1, 0, 1 });
 
-			if (succeed(imr::instancing::begin(_animation_state->get_texture_info())))
+			if (succeed(imr::instancing::begin({ .texture_info = _animation_state->get_texture_info(), .compact = true })))
 			{
 				for (int i = 0; i < test_cnt; ++i)
 				{
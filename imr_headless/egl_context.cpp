@@ -0,0 +1,177 @@
+#include "egl_context.h"
+#include <EGL/eglext.h>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	bool client_extension(const char* name)
+	{
+		const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		return extensions && strstr(extensions, name) != nullptr;
+	}
+
+	EGLDisplay surfaceless_display()
+	{
+		if (client_extension("EGL_MESA_platform_surfaceless") == false)
+		{
+			return EGL_NO_DISPLAY;
+		}
+		auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (get_platform_display == nullptr)
+		{
+			return EGL_NO_DISPLAY;
+		}
+		return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+}
+
+namespace imr::headless
+{
+	result egl_context::create()
+	{
+		destroy();
+		bool surfaceless = true;
+		_display = surfaceless_display();
+		EGLint major = 0;
+		EGLint minor = 0;
+		if (_display == EGL_NO_DISPLAY || eglInitialize(_display, &major, &minor) == EGL_FALSE)
+		{
+			surfaceless = false;
+			_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			if (_display == EGL_NO_DISPLAY || eglInitialize(_display, &major, &minor) == EGL_FALSE)
+			{
+				_display = EGL_NO_DISPLAY;
+				return { .type = result_type::fail, .error_code = 1, .msg = "no egl display" };
+			}
+		}
+		if (eglBindAPI(EGL_OPENGL_ES_API) == EGL_FALSE)
+		{
+			destroy();
+			return { .type = result_type::fail, .error_code = 2, .msg = "egl has no gles" };
+		}
+
+		const EGLint config_attribs[] = {
+			EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_ALPHA_SIZE, 8,
+			EGL_NONE,
+		};
+		EGLConfig config = {};
+		EGLint config_count = 0;
+		if (eglChooseConfig(_display, config_attribs, &config, 1, &config_count) == EGL_FALSE || config_count == 0)
+		{
+			destroy();
+			return { .type = result_type::fail, .error_code = 3, .msg = "no gles3 egl config" };
+		}
+
+		const EGLint context_attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 0, EGL_NONE };
+		_context = eglCreateContext(_display, config, EGL_NO_CONTEXT, context_attribs);
+		if (_context == EGL_NO_CONTEXT)
+		{
+			destroy();
+			return { .type = result_type::fail, .error_code = 4, .msg = "fail to create gles3 context" };
+		}
+
+		if (surfaceless == false)
+		{
+			const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			_surface = eglCreatePbufferSurface(_display, config, pbuffer_attribs);
+			if (_surface == EGL_NO_SURFACE)
+			{
+				destroy();
+				return { .type = result_type::fail, .error_code = 5, .msg = "fail to create pbuffer" };
+			}
+		}
+		if (eglMakeCurrent(_display, _surface, _surface, _context) == EGL_FALSE)
+		{
+			destroy();
+			return { .type = result_type::fail, .error_code = 6, .msg = "fail to make the context current" };
+		}
+		return {};
+	}
+
+	void egl_context::destroy()
+	{
+		if (_display == EGL_NO_DISPLAY)
+		{
+			return;
+		}
+		eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (_surface != EGL_NO_SURFACE)
+		{
+			eglDestroySurface(_display, _surface);
+			_surface = EGL_NO_SURFACE;
+		}
+		if (_context != EGL_NO_CONTEXT)
+		{
+			eglDestroyContext(_display, _context);
+			_context = EGL_NO_CONTEXT;
+		}
+		eglTerminate(_display);
+		_display = EGL_NO_DISPLAY;
+	}
+
+	void* egl_context::proc_address(const char* name)
+	{
+		return reinterpret_cast<void*>(eglGetProcAddress(name));
+	}
+
+	bool write_ppm(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba)
+	{
+		if (rgba.size() < static_cast<size_t>(width) * height * 4)
+		{
+			return false;
+		}
+		std::ofstream os(path, std::ios::binary);
+		os << "P6\n" << width << " " << height << "\n255\n";
+		std::vector<char> row(static_cast<size_t>(width) * 3);
+		// ppm rows go top first
+		for (int y = height - 1; y >= 0; --y)
+		{
+			const uint8_t* src = &rgba[static_cast<size_t>(y) * width * 4];
+			for (int x = 0; x < width; ++x)
+			{
+				row[x * 3 + 0] = static_cast<char>(src[x * 4 + 0]);
+				row[x * 3 + 1] = static_cast<char>(src[x * 4 + 1]);
+				row[x * 3 + 2] = static_cast<char>(src[x * 4 + 2]);
+			}
+			os.write(row.data(), row.size());
+		}
+		return os.good();
+	}
+
+	bool read_ppm(const std::string& path, int& width, int& height, std::vector<uint8_t>& rgba)
+	{
+		std::ifstream is(path, std::ios::binary);
+		std::string magic;
+		int max_value = 0;
+		is >> magic >> width >> height >> max_value;
+		if (is.good() == false || magic != "P6" || max_value != 255 || width <= 0 || height <= 0)
+		{
+			return false;
+		}
+		is.get();
+		std::vector<char> row(static_cast<size_t>(width) * 3);
+		rgba.resize(static_cast<size_t>(width) * height * 4);
+		for (int y = height - 1; y >= 0; --y)
+		{
+			if (is.read(row.data(), row.size()).good() == false)
+			{
+				return false;
+			}
+			uint8_t* dst = &rgba[static_cast<size_t>(y) * width * 4];
+			for (int x = 0; x < width; ++x)
+			{
+				dst[x * 4 + 0] = static_cast<uint8_t>(row[x * 3 + 0]);
+				dst[x * 4 + 1] = static_cast<uint8_t>(row[x * 3 + 1]);
+				dst[x * 4 + 2] = static_cast<uint8_t>(row[x * 3 + 2]);
+				dst[x * 4 + 3] = 255;
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <EGL/egl.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "imr_core.h"
+
+namespace imr::headless
+{
+	// a gles3 context without a window. surfaceless (EGL_MESA_platform_surfaceless) when the driver has it,
+	// otherwise a 1x1 pbuffer on the default display. rendering goes to imr::frame_buffer targets either way
+	class egl_context
+	{
+	public:
+		~egl_context()
+		{
+			destroy();
+		}
+
+		result create();
+		void destroy();
+
+		bool surfaceless() const { return _surface == EGL_NO_SURFACE; }
+		// eglGetProcAddress, for imr::gl_proc_loader
+		static void* proc_address(const char* name);
+
+	private:
+		EGLDisplay _display = EGL_NO_DISPLAY;
+		EGLContext _context = EGL_NO_CONTEXT;
+		EGLSurface _surface = EGL_NO_SURFACE;
+	};
+
+	// binary ppm from read_pixels output (rgba, rows bottom first), alpha is dropped
+	bool write_ppm(const std::string& path, int width, int height, const std::vector<uint8_t>& rgba);
+	// back into the read_pixels layout with alpha 255, false when the file isn't a binary 8 bit ppm
+	bool read_ppm(const std::string& path, int& width, int& height, std::vector<uint8_t>& rgba);
+}
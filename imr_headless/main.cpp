@@ -0,0 +1,200 @@
+#include "egl_context.h"
+#include "imr_opengl3.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// renders a built-in scene offscreen (no window, no gpu needed on mesa llvmpipe), writes it as a ppm and
+// optionally compares it against a reference. exits with 2 when the image differs and 3 when the reference can't be read.
+// usage: imr_headless [--width 800] [--height 600] [--frames 1] [--out image.ppm] [--compare reference.ppm] [--tolerance 2]
+// build (linux): cmake -S . -B build && cmake --build build --target imr_headless
+namespace
+{
+	enum exit_code
+	{
+		exit_ok = 0,
+		exit_error = 1,
+		exit_differs = 2,
+		exit_no_reference = 3,
+	};
+
+	struct options
+	{
+		int width = 800;
+		int height = 600;
+		int frames = 1;
+		std::string out = "imr_headless.ppm";
+		std::string compare = {};
+		int tolerance = 2;
+	};
+
+	bool parse(int argc, char** argv, options& opt)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			if (i + 1 >= argc)
+			{
+				return false;
+			}
+			const char* value = argv[++i];
+			if (arg == "--width") opt.width = std::atoi(value);
+			else if (arg == "--height") opt.height = std::atoi(value);
+			else if (arg == "--frames") opt.frames = std::atoi(value);
+			else if (arg == "--out") opt.out = value;
+			else if (arg == "--compare") opt.compare = value;
+			else if (arg == "--tolerance") opt.tolerance = std::atoi(value);
+			else return false;
+		}
+		return opt.width > 0 && opt.height > 0 && opt.frames > 0;
+	}
+
+	// only built-in resources, so the image doesn't depend on the working directory
+	void draw_scene(imr::Iframe_buffer* target, float time)
+	{
+		if (imr::failed(imr::camera::begin({ .frame_buffer = target, .deferred = true })))
+		{
+			return;
+		}
+		imr::camera::clear({ 0.1f, 0.1f, 0.12f, 1 });
+
+		if (imr::succeed(imr::instancing::begin({ .texture_info = imr::get_white_texture_info() })))
+		{
+			for (int y = 0; y < 24; ++y)
+			{
+				for (int x = 0; x < 32; ++x)
+				{
+					imr::instancing::instance({
+						.position = { x * 24.0f - 372.0f, y * 24.0f - 276.0f },
+						.scale = { 18.0f, 18.0f },
+						.rotation = time * 30.0f + (x + y) * 3.0f,
+						.color = { x / 31.0f, y / 23.0f, 0.6f, 0.35f },
+						});
+				}
+			}
+			imr::instancing::end();
+		}
+
+		if (imr::succeed(imr::primitive::begin()))
+		{
+			imr::primitive::circle({ .center = { -250, -150 }, .radius = 60, .thickness = 4, .color = { 1, 0.8f, 0.2f, 1 } });
+			imr::primitive::circle({ .center = { -250, -150 }, .radius = 30, .color = { 1, 0.4f, 0.1f, 1 }, .filled = true });
+			imr::primitive::rect({ .center = { 0, -150 }, .size = { 160, 90 }, .rotation = 15, .corner_radius = 20, .color = { 0.2f, 0.8f, 1, 1 }, .filled = true });
+			imr::primitive::capsule({ .from = { 150, -200 }, .to = { 320, -100 }, .radius = 18, .thickness = 3, .color = { 0.4f, 1, 0.4f, 1 } });
+			imr::primitive::line({ .from = { -350, 50 }, .to = { 350, 80 }, .thickness = 3, .color = { 1, 1, 1, 1 } });
+
+			imr::float2 star[10] = {};
+			for (int i = 0; i < 10; ++i)
+			{
+				float radius = i % 2 ? 40.0f : 100.0f;
+				float angle = i * 3.14159265f / 5.0f;
+				star[i] = imr::float2(radius * std::sin(angle), 170.0f + radius * std::cos(angle));
+			}
+			imr::primitive::polygon({ .points = star, .color = { 1, 0.5f, 0, 1 }, .cache = true });
+			imr::primitive::polygon({ .points = star, .filled = false, .thickness = 4, .color = { 1, 1, 1, 1 }, .cache = true });
+			imr::primitive::end();
+		}
+		imr::camera::end();
+	}
+
+	exit_code compare(const options& opt, const std::vector<uint8_t>& pixels)
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<uint8_t> reference = {};
+		if (imr::headless::read_ppm(opt.compare, width, height, reference) == false)
+		{
+			std::cerr << "fail to read " << opt.compare << std::endl;
+			return exit_no_reference;
+		}
+		if (width != opt.width || height != opt.height)
+		{
+			std::cerr << "reference is " << width << "x" << height << ", rendered " << opt.width << "x" << opt.height << std::endl;
+			return exit_differs;
+		}
+		size_t differ = 0;
+		int max_diff = 0;
+		for (size_t i = 0; i < pixels.size(); i += 4)
+		{
+			int diff = 0;
+			for (size_t c = 0; c < 3; ++c)
+			{
+				diff = std::max(diff, std::abs(static_cast<int>(pixels[i + c]) - static_cast<int>(reference[i + c])));
+			}
+			max_diff = std::max(max_diff, diff);
+			differ += diff > opt.tolerance ? 1 : 0;
+		}
+		std::cout << "compare " << opt.compare << ": " << differ << " pixels over tolerance " << opt.tolerance << ", max difference " << max_diff << std::endl;
+		return differ == 0 ? exit_ok : exit_differs;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	options opt = {};
+	if (parse(argc, argv, opt) == false)
+	{
+		std::cerr << "usage: imr_headless [--width 800] [--height 600] [--frames 1] [--out image.ppm] [--compare reference.ppm] [--tolerance 2]" << std::endl;
+		return exit_error;
+	}
+
+	imr::headless::egl_context egl = {};
+	auto ret = egl.create();
+	if (imr::failed(ret))
+	{
+		std::cerr << "egl: " << ret.msg << std::endl;
+		return exit_error;
+	}
+	imr::gl_proc_loader = &imr::headless::egl_context::proc_address;
+	ret = imr::initialize();
+	if (imr::failed(ret))
+	{
+		std::cerr << "imr::initialize: " << ret.msg << std::endl;
+		return exit_error;
+	}
+	std::cout << (egl.surfaceless() ? "surfaceless " : "pbuffer ") << glGetString(GL_RENDERER) << std::endl;
+
+	exit_code code = exit_ok;
+	{
+		auto target = imr::acquire_render_target({ .width = opt.width, .height = opt.height, .depth = true });
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < opt.frames; ++i)
+		{
+			imr::stats::update();
+			imr::update_render_targets();
+			// a fixed step keeps the last frame the same from run to run
+			draw_scene(target.get(), i / 60.0f);
+		}
+		glFinish();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::vector<uint8_t> pixels = {};
+		ret = imr::read_pixels(target.get(), pixels);
+		if (imr::failed(ret))
+		{
+			std::cerr << "read_pixels: " << ret.msg << std::endl;
+			code = exit_error;
+		}
+		else
+		{
+			imr::stats::update();
+			auto& work = imr::stats::latest().work;
+			std::cout << opt.frames << " frames " << opt.width << "x" << opt.height << ", " << ms / opt.frames << " ms/frame, "
+				<< work.draw_calls << " draw calls, " << work.instances << " instances" << std::endl;
+			if (opt.out.empty() == false && imr::headless::write_ppm(opt.out, opt.width, opt.height, pixels) == false)
+			{
+				std::cerr << "fail to write " << opt.out << std::endl;
+				code = exit_error;
+			}
+			if (opt.compare.empty() == false && code == exit_ok)
+			{
+				code = compare(opt, pixels);
+			}
+		}
+	}
+
+	imr::deinitialize();
+	egl.destroy();
+	return code;
+}
@@ -0,0 +1,394 @@
+#include "etc2_encoder.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	using imr::texconv::rgba_image;
+
+	// etc1 intensity tables, selector 0..3 picks +a, +b, -a, -b
+	const int ETC_MODIFIERS[8][2] = {
+		{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+	};
+
+	const int EAC_MODIFIERS[16][8] = {
+		{ -3, -6, -9, -15, 2, 5, 8, 14 },
+		{ -3, -7, -10, -13, 2, 6, 9, 12 },
+		{ -2, -5, -8, -13, 1, 4, 7, 12 },
+		{ -2, -4, -6, -13, 1, 3, 5, 12 },
+		{ -3, -6, -8, -12, 2, 5, 7, 11 },
+		{ -3, -7, -9, -11, 2, 6, 8, 10 },
+		{ -4, -7, -8, -11, 3, 6, 7, 10 },
+		{ -3, -5, -8, -11, 2, 4, 7, 10 },
+		{ -2, -6, -8, -10, 1, 5, 7, 9 },
+		{ -2, -5, -8, -10, 1, 4, 7, 9 },
+		{ -2, -4, -8, -10, 1, 3, 7, 9 },
+		{ -2, -5, -7, -10, 1, 4, 6, 9 },
+		{ -3, -4, -7, -10, 2, 3, 6, 9 },
+		{ -1, -2, -3, -10, 0, 1, 2, 9 },
+		{ -4, -6, -8, -9, 3, 5, 7, 8 },
+		{ -3, -5, -7, -9, 2, 4, 6, 8 },
+	};
+
+	// texels of one 4x4 block in etc order, texel (x, y) is at x * 4 + y
+	struct block
+	{
+		int rgba[16][4] = {};
+	};
+
+	void fetch_block(const rgba_image& image, int bx, int by, block& out)
+	{
+		for (int x = 0; x < 4; ++x)
+		{
+			for (int y = 0; y < 4; ++y)
+			{
+				int sx = std::min(bx * 4 + x, image.width - 1);
+				int sy = std::min(by * 4 + y, image.height - 1);
+				const uint8_t* src = &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * 4];
+				for (int c = 0; c < 4; ++c)
+				{
+					out.rgba[x * 4 + y][c] = src[c];
+				}
+			}
+		}
+	}
+
+	int clamp_byte(int v)
+	{
+		return std::clamp(v, 0, 255);
+	}
+
+	// texel indices of the two sub-blocks, side by side 2x4 halves or with flip top and bottom 4x2 halves
+	void sub_block_texels(bool flip, int sub, int (&out)[8])
+	{
+		int n = 0;
+		for (int x = 0; x < 4; ++x)
+		{
+			for (int y = 0; y < 4; ++y)
+			{
+				int half = flip ? y / 2 : x / 2;
+				if (half == sub)
+				{
+					out[n++] = x * 4 + y;
+				}
+			}
+		}
+	}
+
+	// color error is weighted by alpha so fully transparent texels hardly count
+	int64_t texel_error(const int* texel, int r, int g, int b)
+	{
+		int dr = texel[0] - r;
+		int dg = texel[1] - g;
+		int db = texel[2] - b;
+		return static_cast<int64_t>(dr * dr + dg * dg + db * db) * (texel[3] + 1);
+	}
+
+	void average(const block& b, const int (&texels)[8], float (&out)[3])
+	{
+		float sum[3] = {};
+		float weight = 0;
+		for (int i : texels)
+		{
+			float w = static_cast<float>(b.rgba[i][3] + 1);
+			for (int c = 0; c < 3; ++c)
+			{
+				sum[c] += b.rgba[i][c] * w;
+			}
+			weight += w;
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			out[c] = sum[c] / weight;
+		}
+	}
+
+	struct sub_block_fit
+	{
+		int64_t error = std::numeric_limits<int64_t>::max();
+		int table = 0;
+		int selectors[8] = {};
+	};
+
+	// best intensity table and selectors for a sub-block around base
+	sub_block_fit fit_sub_block(const block& b, const int (&texels)[8], const int (&base)[3])
+	{
+		sub_block_fit ret = {};
+		for (int table = 0; table < 8; ++table)
+		{
+			sub_block_fit fit = { .error = 0, .table = table };
+			for (int i = 0; i < 8; ++i)
+			{
+				const int* texel = b.rgba[texels[i]];
+				int64_t best = std::numeric_limits<int64_t>::max();
+				for (int s = 0; s < 4; ++s)
+				{
+					int modifier = ETC_MODIFIERS[table][s & 1] * ((s & 2) ? -1 : 1);
+					int64_t e = texel_error(texel, clamp_byte(base[0] + modifier), clamp_byte(base[1] + modifier), clamp_byte(base[2] + modifier));
+					if (e < best)
+					{
+						best = e;
+						fit.selectors[i] = s;
+					}
+				}
+				fit.error += best;
+			}
+			if (fit.error < ret.error)
+			{
+				ret = fit;
+			}
+		}
+		return ret;
+	}
+
+	struct color_block
+	{
+		int64_t error = std::numeric_limits<int64_t>::max();
+		uint8_t bytes[8] = {};
+	};
+
+	void write_selectors(color_block& out, const int (&texels)[8], const sub_block_fit& fit)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			int t = texels[i];
+			int msb = (fit.selectors[i] >> 1) & 1;
+			int lsb = fit.selectors[i] & 1;
+			// msbs in bytes 4-5, lsbs in bytes 6-7, texel 15 is the lowest bit of each half
+			out.bytes[5 - t / 8] |= static_cast<uint8_t>(msb << (t % 8));
+			out.bytes[7 - t / 8] |= static_cast<uint8_t>(lsb << (t % 8));
+		}
+	}
+
+	color_block encode_color_block(const block& b)
+	{
+		color_block ret = {};
+		for (int flip = 0; flip < 2; ++flip)
+		{
+			int texels[2][8] = {};
+			float averages[2][3] = {};
+			for (int sub = 0; sub < 2; ++sub)
+			{
+				sub_block_texels(flip != 0, sub, texels[sub]);
+				average(b, texels[sub], averages[sub]);
+			}
+
+			// individual mode, two rgb444 bases
+			{
+				int q[2][3] = {};
+				int base[2][3] = {};
+				for (int sub = 0; sub < 2; ++sub)
+				{
+					for (int c = 0; c < 3; ++c)
+					{
+						q[sub][c] = std::clamp(static_cast<int>(std::lround(averages[sub][c] * 15.0f / 255.0f)), 0, 15);
+						base[sub][c] = q[sub][c] * 17;
+					}
+				}
+				auto fit0 = fit_sub_block(b, texels[0], base[0]);
+				auto fit1 = fit_sub_block(b, texels[1], base[1]);
+				if (fit0.error + fit1.error < ret.error)
+				{
+					color_block candidate = { .error = fit0.error + fit1.error };
+					for (int c = 0; c < 3; ++c)
+					{
+						candidate.bytes[c] = static_cast<uint8_t>((q[0][c] << 4) | q[1][c]);
+					}
+					candidate.bytes[3] = static_cast<uint8_t>((fit0.table << 5) | (fit1.table << 2) | flip);
+					write_selectors(candidate, texels[0], fit0);
+					write_selectors(candidate, texels[1], fit1);
+					ret = candidate;
+				}
+			}
+
+			// differential mode, rgb555 base and a 3 bit signed delta. staying in range keeps etc2 from reading it as t, h or planar
+			{
+				int q[2][3] = {};
+				int delta[3] = {};
+				int base[2][3] = {};
+				for (int c = 0; c < 3; ++c)
+				{
+					q[0][c] = std::clamp(static_cast<int>(std::lround(averages[0][c] * 31.0f / 255.0f)), 0, 31);
+					q[1][c] = std::clamp(static_cast<int>(std::lround(averages[1][c] * 31.0f / 255.0f)), 0, 31);
+					delta[c] = std::clamp(q[1][c] - q[0][c], -4, 3);
+					q[1][c] = q[0][c] + delta[c];
+					for (int sub = 0; sub < 2; ++sub)
+					{
+						base[sub][c] = (q[sub][c] << 3) | (q[sub][c] >> 2);
+					}
+				}
+				auto fit0 = fit_sub_block(b, texels[0], base[0]);
+				auto fit1 = fit_sub_block(b, texels[1], base[1]);
+				if (fit0.error + fit1.error < ret.error)
+				{
+					color_block candidate = { .error = fit0.error + fit1.error };
+					for (int c = 0; c < 3; ++c)
+					{
+						candidate.bytes[c] = static_cast<uint8_t>((q[0][c] << 3) | (delta[c] & 7));
+					}
+					candidate.bytes[3] = static_cast<uint8_t>((fit0.table << 5) | (fit1.table << 2) | 2 | flip);
+					write_selectors(candidate, texels[0], fit0);
+					write_selectors(candidate, texels[1], fit1);
+					ret = candidate;
+				}
+			}
+		}
+		return ret;
+	}
+
+	void encode_alpha_block(const block& b, uint8_t (&out)[8])
+	{
+		int lo = 255;
+		int hi = 0;
+		for (auto& texel : b.rgba)
+		{
+			lo = std::min(lo, texel[3]);
+			hi = std::max(hi, texel[3]);
+		}
+
+		int best_base = lo;
+		int best_table = 13;
+		int best_multiplier = 1;
+		int best_selectors[16] = { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 };
+		// table 13 has a zero modifier for flat blocks
+		if (lo != hi)
+		{
+			int64_t best_error = std::numeric_limits<int64_t>::max();
+			for (int table = 0; table < 16; ++table)
+			{
+				const int* modifiers = EAC_MODIFIERS[table];
+				int span = modifiers[7] - modifiers[3];
+				int guess = (hi - lo + span / 2) / span;
+				for (int multiplier = std::max(1, guess - 1); multiplier <= std::min(15, guess + 1); ++multiplier)
+				{
+					int base_guess = lo - modifiers[3] * multiplier;
+					for (int base = std::max(0, base_guess - 2); base <= std::min(255, base_guess + 2); ++base)
+					{
+						int64_t error = 0;
+						int selectors[16] = {};
+						for (int i = 0; i < 16 && error < best_error; ++i)
+						{
+							int64_t best = std::numeric_limits<int64_t>::max();
+							for (int s = 0; s < 8; ++s)
+							{
+								int d = clamp_byte(base + modifiers[s] * multiplier) - b.rgba[i][3];
+								if (d * d < best)
+								{
+									best = d * d;
+									selectors[i] = s;
+								}
+							}
+							error += best;
+						}
+						if (error < best_error)
+						{
+							best_error = error;
+							best_base = base;
+							best_table = table;
+							best_multiplier = multiplier;
+							std::copy(std::begin(selectors), std::end(selectors), best_selectors);
+						}
+					}
+				}
+			}
+		}
+
+		uint64_t bits = (static_cast<uint64_t>(best_base) << 56) | (static_cast<uint64_t>(best_multiplier) << 52) | (static_cast<uint64_t>(best_table) << 48);
+		for (int i = 0; i < 16; ++i)
+		{
+			bits |= static_cast<uint64_t>(best_selectors[i]) << (45 - 3 * i);
+		}
+		for (int i = 0; i < 8; ++i)
+		{
+			out[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+		}
+	}
+
+	std::vector<uint8_t> encode(const rgba_image& image, bool alpha)
+	{
+		const int blocks_x = (image.width + 3) / 4;
+		const int blocks_y = (image.height + 3) / 4;
+		const size_t block_size = alpha ? 16 : 8;
+		std::vector<uint8_t> ret(static_cast<size_t>(blocks_x) * blocks_y * block_size);
+		uint8_t* dst = ret.data();
+		block b = {};
+		for (int by = 0; by < blocks_y; ++by)
+		{
+			for (int bx = 0; bx < blocks_x; ++bx)
+			{
+				fetch_block(image, bx, by, b);
+				if (alpha)
+				{
+					uint8_t alpha_bytes[8] = {};
+					encode_alpha_block(b, alpha_bytes);
+					std::copy(std::begin(alpha_bytes), std::end(alpha_bytes), dst);
+					dst += 8;
+				}
+				auto color = encode_color_block(b);
+				std::copy(std::begin(color.bytes), std::end(color.bytes), dst);
+				dst += 8;
+			}
+		}
+		return ret;
+	}
+}
+
+namespace imr::texconv
+{
+	bool is_opaque(const rgba_image& image)
+	{
+		for (size_t i = 3; i < image.pixels.size(); i += 4)
+		{
+			if (image.pixels[i] != 255)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	rgba_image downsample(const rgba_image& image)
+	{
+		rgba_image ret = { .width = std::max(1, image.width / 2), .height = std::max(1, image.height / 2) };
+		ret.pixels.resize(static_cast<size_t>(ret.width) * ret.height * 4);
+		for (int y = 0; y < ret.height; ++y)
+		{
+			for (int x = 0; x < ret.width; ++x)
+			{
+				int color[3] = {};
+				int alpha = 0;
+				int plain[3] = {};
+				for (int i = 0; i < 4; ++i)
+				{
+					int sx = std::min(x * 2 + (i & 1), image.width - 1);
+					int sy = std::min(y * 2 + (i >> 1), image.height - 1);
+					const uint8_t* src = &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * 4];
+					for (int c = 0; c < 3; ++c)
+					{
+						color[c] += src[c] * src[3];
+						plain[c] += src[c];
+					}
+					alpha += src[3];
+				}
+				uint8_t* dst = &ret.pixels[(static_cast<size_t>(y) * ret.width + x) * 4];
+				for (int c = 0; c < 3; ++c)
+				{
+					dst[c] = static_cast<uint8_t>(alpha > 0 ? (color[c] + alpha / 2) / alpha : (plain[c] + 2) / 4);
+				}
+				dst[3] = static_cast<uint8_t>((alpha + 2) / 4);
+			}
+		}
+		return ret;
+	}
+
+	std::vector<uint8_t> encode_etc2_rgb(const rgba_image& image)
+	{
+		return encode(image, false);
+	}
+
+	std::vector<uint8_t> encode_etc2_rgba(const rgba_image& image)
+	{
+		return encode(image, true);
+	}
+}
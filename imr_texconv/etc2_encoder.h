@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+namespace imr::texconv
+{
+	// rgba8 pixels, rows ordered the way they are uploaded (bottom row first)
+	struct rgba_image
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<uint8_t> pixels = {};
+	};
+
+	bool is_opaque(const rgba_image& image);
+
+	// half size level for the mip chain, colors are weighted by alpha so transparent texels don't bleed in
+	rgba_image downsample(const rgba_image& image);
+
+	// ETC2 RGB8, 8 bytes per 4x4 block. only the etc1 compatible individual and differential modes are used
+	std::vector<uint8_t> encode_etc2_rgb(const rgba_image& image);
+
+	// ETC2 RGBA8, an EAC alpha block followed by the color block, 16 bytes per 4x4 block
+	std::vector<uint8_t> encode_etc2_rgba(const rgba_image& image);
+}
@@ -0,0 +1,84 @@
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "etc2_encoder.h"
+#include "ktx.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// converts a png into an ETC2 KTX with a full mip chain, load_texture picks the KTX up by its header.
+// usage: imr_texconv <input.png> <output.ktx> [--no-mips]
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: imr_texconv <input.png> <output.ktx> [--no-mips]" << std::endl;
+		return 1;
+	}
+	const std::string input = argv[1];
+	const std::string output = argv[2];
+	bool mips = true;
+	for (int i = 3; i < argc; ++i)
+	{
+		if (std::string(argv[i]) == "--no-mips")
+		{
+			mips = false;
+		}
+	}
+
+	imr::texconv::rgba_image image = {};
+	int nr_channels = 0;
+	// same orientation as load_texture, so atlas uvs stay valid
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* data = stbi_load(input.c_str(), &image.width, &image.height, &nr_channels, 4);
+	if (data == nullptr)
+	{
+		std::cerr << "fail to load " << input << " : " << stbi_failure_reason() << std::endl;
+		return 1;
+	}
+	image.pixels.assign(data, data + static_cast<size_t>(image.width) * image.height * 4);
+	stbi_image_free(data);
+
+	const bool opaque = imr::texconv::is_opaque(image);
+	imr::ktx::header head = {};
+	memcpy(head.identifier, imr::ktx::IDENTIFIER, sizeof(head.identifier));
+	head.gl_internal_format = opaque ? imr::ktx::COMPRESSED_RGB8_ETC2 : imr::ktx::COMPRESSED_RGBA8_ETC2_EAC;
+	head.gl_base_internal_format = opaque ? imr::ktx::BASE_RGB : imr::ktx::BASE_RGBA;
+	head.pixel_width = image.width;
+	head.pixel_height = image.height;
+	head.mipmap_level_count = 1;
+	if (mips)
+	{
+		for (int w = image.width, h = image.height; w > 1 || h > 1; w = std::max(1, w / 2), h = std::max(1, h / 2))
+		{
+			head.mipmap_level_count++;
+		}
+	}
+
+	std::vector<uint8_t> file(sizeof(head));
+	memcpy(file.data(), &head, sizeof(head));
+	size_t uncompressed = 0;
+	auto level = image;
+	for (uint32_t i = 0; i < head.mipmap_level_count; ++i)
+	{
+		if (i > 0)
+		{
+			level = imr::texconv::downsample(level);
+		}
+		imr::ktx::write_level(file, opaque ? imr::texconv::encode_etc2_rgb(level) : imr::texconv::encode_etc2_rgba(level));
+		uncompressed += level.pixels.size();
+	}
+
+	std::ofstream os(output, std::ios::binary);
+	os.write(reinterpret_cast<const char*>(file.data()), file.size());
+	if (os.good() == false)
+	{
+		std::cerr << "fail to write " << output << std::endl;
+		return 1;
+	}
+	std::cout << input << " -> " << output << " " << image.width << "x" << image.height
+		<< (opaque ? " ETC2 RGB8, " : " ETC2 RGBA8 EAC, ") << head.mipmap_level_count << " levels, "
+		<< uncompressed << " -> " << file.size() << " bytes" << std::endl;
+	return 0;
+}